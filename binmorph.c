@@ -44,14 +44,18 @@ static bool __Init_done = false; // == true if arrays are inited
  */
 static void morph_init(){
 	if(__Init_done) return;
-	int i;
-	ER = MALLOC(uint8_t, 256);
-	DIL = MALLOC(uint8_t, 256);
-	for(i = 0; i < 256; i++){
-		ER[i]  = i & ((i << 1) | 1) & ((i >> 1) | (0x80)); // don't forget that << and >> set borders to zero
-		DIL[i] = i | (i << 1) | (i >> 1);
+	// images of multi-extension file could be processed in parallel
+	#pragma omp critical (morph_init)
+	if(!__Init_done){
+		int i;
+		ER = MALLOC(uint8_t, 256);
+		DIL = MALLOC(uint8_t, 256);
+		for(i = 0; i < 256; i++){
+			ER[i]  = i & ((i << 1) | 1) & ((i >> 1) | (0x80)); // don't forget that << and >> set borders to zero
+			DIL[i] = i | (i << 1) | (i >> 1);
+		}
+		__Init_done = true;
 	}
-	__Init_done = true;
 }
 /*
  * <=================== AUXILIARY FUNCTIONS ===================
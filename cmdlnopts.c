@@ -64,6 +64,21 @@ glob_pars const Gdefault = {
     ,.flip = NULL
     ,.deltabs = 0
     ,.listabs = 0
+    ,.striph = 0
+    ,.otype = NULL
+    ,.zcomp = NULL
+    ,.ztile = NULL
+    ,.zquant = 4.
+    ,.tabvla = 0
+    ,.batch = NULL
+    ,.batchout = NULL
+    ,.ingest = NULL
+    ,.ingestout = NULL
+    ,.ingestring = NULL
+    ,.ingestwait = 10.
+    ,.daemon = NULL
+    ,.fftwplan = NULL
+    ,.wisdom = NULL
 };
 
 /// "  , : type:[help]:...\n\t\ttype -   (help  )\n\t\thelp -     'type' "
@@ -120,6 +135,21 @@ myoption cmdlnopts[] = {
     {"flip",    NEED_ARG,   NULL,   'f',        arg_string, APTR(&G.flip),      N_("flip image (arg = X, Y or XY)")},
     {"no-tabs", NO_ARGS,    &G.deltabs,1,   arg_none,   NULL,               N_("don't save any tables in output file")},
     {"list-tabs",NO_ARGS,   &G.listabs,1,   arg_none,   NULL,               N_("List all tables in input file")},
+    {"strip",   NEED_ARG,   NULL,   0,      arg_int,    APTR(&G.striph),    N_("read & process input image by strips of given height (rows)")},
+    {"otype",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.otype),     N_("output data type: 8, 16, u16, 32, 64, -32 or -64 (default: type of input)")},
+    {"zcomp",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.zcomp),     N_("compress output image by tiles: rice, gzip or hcompress (hcompress isn't parallel)")},
+    {"ztile",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.ztile),     N_("size of compression tiles, WxH (default: one row)")},
+    {"zquant",  NEED_ARG,   NULL,   0,      arg_double, APTR(&G.zquant),    N_("quantization level for compression of floating point data (0 - lossless, default: 4)")},
+    {"batch",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.batch),     N_("process all files from given list (file with names, '-' for stdin) or glob pattern")},
+    {"batch-out",NEED_ARG,  NULL,   0,      arg_string, APTR(&G.batchout),  N_("output file names template for batch mode, %s is input name without extension (default: %s_proc.fits)")},
+    {"ingest",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.ingest),    N_("process raw frames from shared memory ring buffer with given name")},
+    {"ingest-out",NEED_ARG, NULL,   0,      arg_string, APTR(&G.ingestout), N_("output file names template for ingest mode, %d is frame number (e.g. frame%04d.fits)")},
+    {"ingest-ring",NEED_ARG,NULL,   0,      arg_string, APTR(&G.ingestring),N_("put processed frames into shared memory ring buffer with given name")},
+    {"ingest-wait",NEED_ARG,NULL,   0,      arg_double, APTR(&G.ingestwait),N_("time (seconds) to wait for producer or consumer of ring buffers (default: 10)")},
+    {"daemon",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.daemon),    N_("run as server processing jobs \"infile outfile [pipeline]...\" got from UNIX socket with given path")},
+    {"fftw-plan",NEED_ARG,  NULL,   0,      arg_string, APTR(&G.fftwplan),  N_("FFTW planning mode: estimate (default), measure or patient")},
+    {"fftw-wisdom",NEED_ARG,NULL,   0,      arg_string, APTR(&G.wisdom),    N_("file with FFTW wisdom (default: ~/.cache/fitsread/wisdom)")},
+    {"tab-vla", NO_ARGS,    &G.tabvla,1,    arg_none,   NULL,               N_("store string columns of output tables as variable-length arrays")},
     end_option
 };
 
@@ -44,6 +44,21 @@ typedef struct{
 	char *flip;						// parameters for flipping
 	int deltabs;					// delete all tables
 	int listabs;					// list all tables from input file
+	int striph;						// process image by strips of given height (rows)
+	char *otype;					// output data type (BITPIX)
+	char *zcomp;					// tile compression algorithm of output image
+	char *ztile;					// size of compression tiles (WxH)
+	double zquant;					// quantization level for compression of floating point data
+	int tabvla;						// store string columns of tables as variable-length arrays
+	char *batch;					// list of files or glob pattern for batch mode
+	char *batchout;					// template of output file names for batch mode
+	char *ingest;					// name of shared memory ring buffer with input frames
+	char *ingestout;				// template of output file names for ingest mode
+	char *ingestring;				// name of shared memory ring buffer for output frames
+	double ingestwait;				// timeout for waiting of producer/consumer of ring buffers
+	char *daemon;					// path of UNIX socket for daemon mode
+	char *fftwplan;					// FFTW planning mode
+	char *wisdom;					// file with FFTW wisdom
 } glob_pars;
 
 
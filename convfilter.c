@@ -21,46 +21,224 @@
 #include <stdio.h>
 #include <fftw3.h>
 #include <math.h>
+#include <limits.h>
+#include <strings.h>
 
 #include "usefull_macros.h"
 #include "convfilter.h"
+#ifdef OMP_FOUND
+#include <omp.h>
+#endif
 
-// from http://graphics.stanford.edu/%7Eseander/bithacks.html#RoundUpPowerOf2
-int nextpow2(int i, int j){
-	inline int p2oi(int i){
-		unsigned int v = (unsigned int)i - 1;
-		v |= v >> 1;
-		v |= v >> 2;
-		v |= v >> 4;
-		v |= v >> 8;
-		v |= v >> 16;
-		v++;
-		return (int) v;
-	}
-	int p1 = p2oi(i), p2 = p2oi(j);
-	return MAX(p1, p2);
-}
-
-void fftshift(int size, Item *m){
-	int h = size/2, ss, ss1, i, j, k, l, p;
-	ss = (2*h+1)*h;
-	ss1 = (2*h-1)*h;
-	for(j = 0; j < h; j++){
-		k = j * size;
-		l = k + h;
-		for(i = 0; i < h; i++, k++, l++){
-			register Item tmp;
-			p = k + ss;
-			tmp = m[k]; m[k] = m[p]; m[p] = tmp;
-			p = l + ss1;
-			tmp = m[l]; m[l] = m[p]; m[p] = tmp;
+/**
+ * amount of FFTW threads: images of multi-extension file are processed
+ * in parallel, so each of them uses only one thread
+ */
+static int fftw_nthreads(){
+#ifdef OMP_FOUND
+	if(omp_in_parallel()) return 1;
+#endif
+	return THREAD_NUMBER;
+}
+
+// FFTW plans are cached by size, direction & amount of threads
+typedef struct{
+	int n0, n1;			// size of real array (rows, columns)
+	bool inverse;		// c2r (TRUE) or r2c transform
+	int nthreads;		// amount of threads
+	fftw_plan plan;
+} fftplan;
+#define FFTW_MAX_PLANS	(64)
+static fftplan plans[FFTW_MAX_PLANS];
+static int nplans = 0;
+static unsigned fftw_flags = FFTW_ESTIMATE;	// planning rigor
+static char *wisdom_file = NULL;			// file with FFTW wisdom or NULL
+static bool wisdom_changed = FALSE;			// new plans were measured
+
+/**
+ * save FFTW wisdom (if new plans were measured) & destroy cached plans
+ */
+static void fftw_finish(){
+	if(wisdom_changed && wisdom_file){
+		char tmp[PATH_MAX], *s;
+		snprintf(tmp, PATH_MAX, "%s", wisdom_file);
+		for(s = strchr(tmp + 1, '/'); s; s = strchr(s + 1, '/')){ // make directories
+			*s = 0;
+			mkdir(tmp, 0755);
+			*s = '/';
+		}
+		// write into temporary file: other processes could read wisdom at the same time
+		snprintf(tmp, PATH_MAX, "%s.%d", wisdom_file, getpid());
+		if(!fftw_export_wisdom_to_filename(tmp) || rename(tmp, wisdom_file)){
+			WARN(_("Can't save FFTW wisdom into %s"), wisdom_file);
+			unlink(tmp);
+		}
+		wisdom_changed = FALSE;
+	}
+	for(int i = 0; i < nplans; ++i) fftw_destroy_plan(plans[i].plan);
+	nplans = 0;
+}
+
+/**
+ * set FFTW planning mode & wisdom file
+ * @param mode   - "estimate" (default), "measure" or "patient", NULL for default
+ * @param wisdom - file with wisdom or NULL for ~/.cache/fitsread/wisdom
+ * @return FALSE if mode is wrong
+ */
+bool fftw_set_planner(char *mode, char *wisdom){
+	char buf[PATH_MAX];
+	if(!mode || strcasecmp(mode, "estimate") == 0) fftw_flags = FFTW_ESTIMATE;
+	else if(strcasecmp(mode, "measure") == 0) fftw_flags = FFTW_MEASURE;
+	else if(strcasecmp(mode, "patient") == 0) fftw_flags = FFTW_PATIENT;
+	else return FALSE;
+	if(!wisdom && getenv("HOME")){
+		snprintf(buf, PATH_MAX, "%s/.cache/fitsread/wisdom", getenv("HOME"));
+		wisdom = buf;
+	}
+	if(wisdom) wisdom_file = strdup(wisdom);
+	atexit(fftw_finish);
+	return TRUE;
+}
+
+/**
+ * get plan for r2c (or c2r if 'inverse') 2-D transform of real array n0 x n1;
+ * plan is executed by fftw_execute_dft_* with arrays allocated by fft_alloc()
+ * and should be returned by put_plan() after that (cached plans are never destroyed
+ * while program works: other threads could execute them; when cache is full, new plans
+ * aren't cached & are destroyed by put_plan())
+ */
+static fftw_plan get_plan_nth(int n0, int n1, bool inverse, int nth){
+	static bool fftw_ini = FALSE;
+	fftw_plan plan = NULL;
+	int i;
+	// FFTW planner isn't thread-safe
+	#pragma omp critical (fftw_planner)
+	{
+		for(i = 0; i < nplans; ++i)
+			if(plans[i].n0 == n0 && plans[i].n1 == n1 && plans[i].inverse == inverse && plans[i].nthreads == nth){
+				plan = plans[i].plan;
+				break;
+			}
+		if(!fftw_ini && (fftw_ini = fftw_init_threads()) && wisdom_file)
+			fftw_import_wisdom_from_filename(wisdom_file);
+		if(!plan && fftw_ini){
+			#ifdef EBUG
+			double t0 = dtime();
+			#endif
+			// arrays are overwritten while measuring, so plan is made with temporary arrays
+			double *r = fftw_alloc_real((size_t)n0 * n1);
+			fftw_complex *c = fftw_alloc_complex((size_t)n0 * (n1/2 + 1));
+			if(r && c){
+				fftw_plan_with_nthreads(nth);
+				if(inverse) plan = fftw_plan_dft_c2r_2d(n0, n1, c, r, fftw_flags);
+				else plan = fftw_plan_dft_r2c_2d(n0, n1, r, c, fftw_flags);
+			}
+			fftw_free(r);
+			fftw_free(c);
+			if(plan){
+				if(nplans < FFTW_MAX_PLANS) plans[nplans++] = (fftplan){n0, n1, inverse, nth, plan};
+				if(fftw_flags != FFTW_ESTIMATE) wisdom_changed = TRUE;
+			}
+			DBG("plan %dx%d, inverse=%d, %d threads: %g s", n0, n1, inverse, nth, dtime() - t0);
 		}
 	}
+	if(!plan) WARNX(_("FFTW error"));
+	return plan;
+}
+
+static fftw_plan get_plan(int n0, int n1, bool inverse){
+	return get_plan_nth(n0, n1, inverse, fftw_nthreads());
+}
+
+/**
+ * release plan got by get_plan(): destroy it if it isn't cached
+ */
+static void put_plan(fftw_plan plan){
+	if(!plan) return;
+	#pragma omp critical (fftw_planner)
+	{
+		int i;
+		for(i = 0; i < nplans && plans[i].plan != plan; ++i);
+		if(i == nplans) fftw_destroy_plan(plan);
+	}
+}
+
+/**
+ * allocate memory for FFT (aligned like arrays of cached plans)
+ */
+static void *fft_alloc(size_t size, bool zero){
+	void *p = fftw_malloc(size);
+	if(!p) ERR(_("Can't allocate memory"));
+	if(zero) memset(p, 0, size);
+	return p;
+}
+
+/**
+ * the smallest number not less than n of form 2^a * 3^b * 5^c * 7^d (FFTW is fast for such sizes)
+ */
+int fft_size(int n){
+	if(n < 2) return 1;
+	for(;; ++n){
+		int m = n;
+		while(m % 2 == 0) m /= 2;
+		while(m % 3 == 0) m /= 3;
+		while(m % 5 == 0) m /= 5;
+		while(m % 7 == 0) m /= 7;
+		if(m == 1) return n;
+	}
+}
+
+// index 'i' (could be negative) mirrored into [0, n)
+static inline int mirror_idx(int i, int n){
+	int p = 2 * n;
+	i %= p;
+	if(i < 0) i += p;
+	return (i < n) ? i : p - 1 - i;
+}
+
+/**
+ * copy w x h part of result 'm' (size nx x ny) into 'out' with shift by (cx, cy):
+ * result of circular convolution is shifted by position of mask center
+ */
+void fftshift(Item *m, int nx, int ny, int cx, int cy, Item *out, int w, int h){
+	int n1 = MIN(w, nx - cx);
+	OMP_FOR()
+	for(int y = 0; y < h; ++y){
+		Item *src = &m[(size_t)((y + cy) % ny) * nx], *dst = &out[(size_t)y * w];
+		memcpy(dst, src + cx, n1 * sizeof(Item));
+		if(n1 < w) memcpy(dst + n1, src, (w - n1) * sizeof(Item));
+	}
+}
+
+// limits of window 'wsz' centered at n/2 in array of size 'n' (whole array if wsz is 0 or too large)
+static void mask_window(int n, int wsz, int *x0, int *x1){
+	if(wsz < n && wsz > 0){
+		*x0 = n / 2 - wsz / 2;
+		*x1 = *x0 + wsz;
+	}else{
+		*x0 = 0;
+		*x1 = n;
+	}
+}
+
+// window covers +-GAUSS_WINDOW/2 sigma, so truncation of Gaussian is negligible
+#define GAUSS_WINDOW	(10.)
+
+static bool whole_gaussian(Filter *f){
+	return f->w >= GAUSS_WINDOW * f->sx && f->h >= GAUSS_WINDOW * f->sy;
 }
 
-// Gaussian mask building/
-Item *build_G_filter(int size, Filter *f){
-	int y0 = 0, y1 = size, x0 = 0, x1 = size;
+// multiplier of Gaussian or LoG mask nx x ny (with normalisation of FFT)
+static double mask_norm(int nx, int ny, Filter *f){
+	if(f->FilterType == GAUSS) return 1./(2*M_PI*f->sx*f->sy) / nx / ny;
+	// LoG normalisation is the same as for square of equal area
+	const double hh = sqrt((double)nx * ny) / 2.;
+	return 1./sqrt(2*M_PI*f->sx*f->sy) / hh / hh / sqrt(hh);
+}
+
+// Gaussian mask building (nx x ny, centered at (nx/2, ny/2))
+Item *build_G_filter(int nx, int ny, Filter *f){
+	int y0, y1, x0, x1;
 	if(f->sx < 1.){
 		WARNX(_("sigma_x is too low, set to 1."));
 		f->sx = 1.;
@@ -70,36 +248,21 @@ Item *build_G_filter(int size, Filter *f){
 		f->sy = 1.;
 	}
 	double sx2 = f->sx * f->sx, sy2 = f->sy * f->sy;
-	double hw, hh;
-	Item *mask = MALLOC(Item, size * size);
+	Item *mask = fft_alloc(sizeof(Item) * nx * ny, TRUE);
 	#ifdef EBUG
 	double t0=dtime();
 	#endif
-	if(f->w < size && f->w > 0){
-		x0 = (size - f->w + 1) / 2;
-		x1 = x0 + f->w;
-	}
-	if(f->h < size && f->h > 0){
-		y0 = (size - f->h + 1) / 2;
-		y1 = y0 + f->h;
-	}
-	hh = -(double)size / 2.;
-	hw = -(double)size / 2.+(double)x0;
-	DBG("y0=%d, y1=%d, hw=%g, hh=%g",y0,y1,hw,hh);
-	const double ss = 1./(2*M_PI*f->sx*f->sy) / size / size;
-	//const double ss = 1./sqrt(2*M_PI*f->sx*f->sy) / size / size / 4.;
+	mask_window(nx, f->w, &x0, &x1);
+	mask_window(ny, f->h, &y0, &y1);
+	DBG("x0=%d, x1=%d, y0=%d, y1=%d", x0, x1, y0, y1);
+	const double ss = mask_norm(nx, ny, f);
 	OMP_FOR(shared(mask))
 	for(int y = y0; y < y1; y++){
-		double X, Y, y2, x2, R;
-		int str, x;
-		X = hw;
-		str = y * size;
-		Y = ((double)y) + hh;
-		y2 = Y*Y/sy2;
-		for(x = x0; x < x1; x++, X+=1.){
-			x2 = X*X/sx2;
-			R = x2 + y2;
-			mask[str + x] = ss * exp(-R/2.);
+		double X = x0 - nx/2, Y = y - ny/2, y2 = Y*Y/sy2;
+		Item *str = &mask[(size_t)y * nx];
+		for(int x = x0; x < x1; x++, X+=1.){
+			double R = X*X/sx2 + y2;
+			str[x] = ss * exp(-R/2.);
 		}
 	}
 	DBG("time=%f\n", dtime()-t0);
@@ -107,41 +270,25 @@ Item *build_G_filter(int size, Filter *f){
 }
 
 
-// Lapgauss mask building
-Item *build_LG_filter(int size, Filter *f){
-	int y0 = 0, y1 = size, x0 = 0, x1 = size;
+// Lapgauss mask building (nx x ny, centered at (nx/2, ny/2))
+Item *build_LG_filter(int nx, int ny, Filter *f){
+	int y0, y1, x0, x1;
 	double sx2 = f->sx * f->sx, sy2 = f->sy * f->sy;
-	double hw, hh;
-	Item *mask = MALLOC(Item, size * size);
+	Item *mask = fft_alloc(sizeof(Item) * nx * ny, TRUE);
 	#ifdef EBUG
 	double t0=dtime();
 	#endif
-	if(f->w < size && f->w > 0){
-		x0 = (size - f->w + 1) / 2;
-		x1 = x0 + f->w;
-	}
-	if(f->h < size && f->h > 0){
-		y0 = (size - f->h + 1) / 2;
-		y1 = y0 + f->h;
-	}
-	hh = -(double)size / 2.;
-	hw = -(double)size / 2.+(double)x0;
-	DBG("y0=%d, y1=%d, x0=%d, x1=%d, hw=%g, hh=%g",y0,y1,x0,x1,hw,hh);
-//	double ss = 3. / hh / hh / sqrt(-hh);
-	const double ss = 1./sqrt(2*M_PI*f->sx*f->sy) / hh / hh / sqrt(-hh);
+	mask_window(nx, f->w, &x0, &x1);
+	mask_window(ny, f->h, &y0, &y1);
+	DBG("x0=%d, x1=%d, y0=%d, y1=%d", x0, x1, y0, y1);
+	const double ss = mask_norm(nx, ny, f);
 	OMP_FOR(shared(mask))
 	for(int y = y0; y < y1; y++){
-		double X, Y, y2, ys2, x2, R;
-		int str, x;
-		X = hw;
-		str = y * size;
-		Y = ((double)y) + hh;
-		y2 = Y*Y/sy2;
-		ys2 = (y2 - 1) / sy2;
-		for(x = x0; x < x1; x++, X+=1.){
-			x2 = X*X/sx2;
-			R = x2 + y2;
-			mask[str + x] = ss * ((x2-1.)/sx2 + ys2) * exp(-R/2.);
+		double X = x0 - nx/2, Y = y - ny/2, y2 = Y*Y/sy2, ys2 = (y2 - 1) / sy2;
+		Item *str = &mask[(size_t)y * nx];
+		for(int x = x0; x < x1; x++, X+=1.){
+			double x2 = X*X/sx2, R = x2 + y2;
+			str[x] = ss * ((x2-1.)/sx2 + ys2) * exp(-R/2.);
 		}
 	}
 	DBG("time=%f\n", dtime()-t0);
@@ -149,58 +296,295 @@ Item *build_LG_filter(int size, Filter *f){
 }
 
 
-// Elementary filter mask building
-Item *build_S_filter(int size, Filter *f){
-	int a0, a1;
-	a0 = (size - 2) / 2;
-	a1 = a0 + 3;
-	//double hh = -(double)(size / 2);
-	double ss = 1. / size / size / 8.;
+// elementary filters 3x3 (x, y are -1, 0 or 1)
+static Item imcopy(Item x, Item y){return (x == 0 && y == 0) ? 1 : 0;}
+static Item sobelh(Item x, Item y){return -x*(2.-fabs(y));}
+static Item sobelv(Item x, Item y){return -y*(2.-fabs(x));}
+static Item prewitth(Item x, _U_ Item y){return x;}
+static Item prewittv(_U_ Item x, Item y){return y;}
+static Item scharrh(Item x, Item y){return -x * (10. - 7.*fabs(y));}
+static Item scharrv(Item x, Item y){return -y * (10. - 7.*fabs(x));}
+
+static Item (*S_filter_fun(FType type))(Item x, Item y){
+	switch(type){
+		case SOBELH:	return sobelh;
+		case SOBELV:	return sobelv;
+		case PREWITTH:	return prewitth;
+		case PREWITTV:	return prewittv;
+		case SCHARRH:	return scharrh;
+		case SCHARRV:	return scharrv;
+		default:		return imcopy;
+	}
+}
+
+// Elementary filter mask building (3x3 centered at (nx/2, ny/2))
+Item *build_S_filter(int nx, int ny, Filter *f){
+	int x0 = nx/2 - 1, y0 = ny/2 - 1;
+	double ss = 1. / nx / ny / 8.;
 	double Y = -1.;
-	Item *mask = MALLOC(Item, size * size);
+	Item *mask = fft_alloc(sizeof(Item) * nx * ny, TRUE);
 	#ifdef EBUG
 	double t0 = dtime();
 	#endif
-	Item (*filtfun)(Item x, Item y);
-	Item imcopy(Item x, Item y){return (x == 0 && y == 0) ? 1 : 0;}
-	Item sobelh(Item x, Item y){return -x*(2.-fabs(y));}
-	Item sobelv(Item x, Item y){return -y*(2.-fabs(x));}
-	Item prewitth(Item x, _U_ Item y){return x;}
-	Item prewittv(_U_ Item x, Item y){return y;}
-	Item scharrh(Item x, Item y){return -x * (10. - 7.*fabs(y));}
-	Item scharrv(Item x, Item y){return -y * (10. - 7.*fabs(x));}
+	Item (*filtfun)(Item x, Item y) = S_filter_fun(f->FilterType);
+	for(int y = y0; y < y0 + 3; y++, Y+=1.){
+		double X = -1.;
+		Item *str = &mask[(size_t)y * nx];
+		for(int x = x0; x < x0 + 3; x++, X+=1.)
+			str[x] = ss*filtfun(X, Y);
+	}
+	DBG("time=%f\n", dtime()-t0);
+	return mask;
+}
+
+/**
+ * get spectrum of image padded to nx x ny (it is computed once & kept in image for next filters)
+ * @return r2c transform or NULL if failed
+ */
+static fftw_complex *image_spectrum(IMAGE *img, int nx, int ny){
+	imgspectrum *sp = img->spectrum;
+	if(sp && sp->nx == nx && sp->ny == ny) return sp->data;
+	fftw_plan plan = get_plan(ny, nx, FALSE);
+	if(!plan) return NULL;
+	int sizex = img->width, sizey = img->height;
+	size_t blklen = sizex * sizeof(Item);
+	Item *inputima = image_data(img);
+	Item *ima = fft_alloc(sizeof(Item) * nx * ny, FALSE);
+	fftw_complex *Fimg = fft_alloc(sizeof(fftw_complex) * ny * (nx/2 + 1), FALSE);
+	// copy image into top left corner & pad it by mirrored image: first half of right (bottom) pad
+	// mirrors right (bottom) edge, the second one - left (top) edge, which is its neighbour in
+	// circular convolution
+	int px = sizex + (nx - sizex + 1) / 2, py = sizey + (ny - sizey + 1) / 2;
+	OMP_FOR(shared(ima, inputima))
+	for(int j = 0; j < ny; ++j){
+		Item *dst = &ima[(size_t)j * nx], *src = &inputima[(size_t)mirror_idx(j < py ? j : j - ny, sizey) * sizex];
+		memcpy(dst, src, blklen);
+		for(int i = sizex; i < nx; ++i)
+			dst[i] = src[mirror_idx(i < px ? i : i - nx, sizex)];
+	}
+	fftw_execute_dft_r2c(plan, ima, Fimg);
+	put_plan(plan);
+	fftw_free(ima);
+	image_changed(img); // spectrum of another size
+	sp = img->spectrum = MALLOC(imgspectrum, 1);
+	sp->nx = nx;
+	sp->ny = ny;
+	sp->data = Fimg;
+	sp->release = fftw_free;
+	return Fimg;
+}
+
+/**
+ * DTFT at frequency 'om' of exp(-n^2/2s^2) sampled at integer n (g) and of its second derivative (d);
+ * sampling aliases are summed for |om| <= pi (for s >= 1 the next ones are below 1e-8)
+ */
+static void gauss_dtft(double om, double s, double *g, double *d){
+	double G = 0., D = 0., c = sqrt(2.*M_PI) * s;
+	for(int k = -1; k < 2; ++k){
+		double w = om + 2.*M_PI*k, e = c * exp(-s*s*w*w/2.);
+		G += e;
+		D -= w*w*e;
+	}
+	*g = G;
+	*d = D;
+}
+
+/**
+ * multiply image spectrum 'Fimg' by analytic spectrum of untruncated Gaussian or LoG mask (centered
+ * at zero, so it is real) and put result into 'F'; both are r2c transforms of nx x ny
+ */
+static void kernel_spectrum_mul(const fftw_complex *Fimg, fftw_complex *F, int nx, int ny, Filter *f){
+	#ifdef EBUG
+	double t0 = dtime();
+	#endif
+	int cx = nx/2 + 1;
+	bool lg = f->FilterType == LAPGAUSS;
+	double *gx = MALLOC(double, 2 * cx), *dx = gx + cx;
+	double *gy = MALLOC(double, 2 * ny), *dy = gy + ny;
+	for(int i = 0; i < cx; ++i)
+		gauss_dtft(2.*M_PI*i/nx, f->sx, &gx[i], &dx[i]);
+	for(int j = 0; j < ny; ++j)
+		gauss_dtft(2.*M_PI*(j <= ny/2 ? j : j - ny)/ny, f->sy, &gy[j], &dy[j]);
+	const double ss = mask_norm(nx, ny, f);
+	OMP_FOR()
+	for(int j = 0; j < ny; ++j){
+		const fftw_complex *src = &Fimg[(size_t)j * cx];
+		fftw_complex *dst = &F[(size_t)j * cx];
+		double g = ss * gy[j], d = ss * dy[j];
+		OMP_SIMD()
+		for(int i = 0; i < cx; ++i){
+			double h = lg ? dx[i]*g + gx[i]*d : gx[i]*g;
+			dst[i][0] = src[i][0] * h;
+			dst[i][1] = src[i][1] * h;
+		}
+	}
+	FREE(gx);
+	FREE(gy);
+	DBG("time=%f\n", dtime()-t0);
+}
+
+// mask of filter 'f' (nx x ny, centered at (nx/2, ny/2))
+static Item *build_mask(int nx, int ny, Filter *f){
 	switch(f->FilterType){
-		case SOBELH:
-			filtfun = sobelh;
-		break;
-		case SOBELV:
-			filtfun = sobelv;
-		break;
-		case PREWITTH:
-			filtfun = prewitth;
-		break;
-		case PREWITTV:
-			filtfun = prewittv;
-		break;
-		case SCHARRH:
-			filtfun = scharrh;
-		break;
-		case SCHARRV:
-			filtfun = scharrv;
-		break;
+		case LAPGAUSS:
+			return build_LG_filter(nx, ny, f);
+		case GAUSS:
+			return build_G_filter(nx, ny, f);
 		default:
-			filtfun = imcopy;
+			return build_S_filter(nx, ny, f);
 	}
-	for(int y = a0; y < a1; y++, Y+=1.){
-		double X = -1.;
-		int str, x;
-		str = y * size;
-		for(x = a0; x < a1; x++, X+=1.){
-			mask[str + x] = ss*filtfun(X, Y);
+}
+
+// relative cost of FFT (per pixel & log2 of its size) against one multiply-add of direct convolution
+#define FFT_COST	(1.25)
+
+/**
+ * check whether direct convolution of w x h image with kw x kh kernel is cheaper than
+ * 'ntrans' FFTs of nx x ny array
+ */
+static bool direct_cheaper(int w, int h, int kw, int kh, int nx, int ny, int ntrans){
+	double n = (double)nx * ny;
+	return (double)kw * kh * w * h < FFT_COST * ntrans * n * log2(n);
+}
+
+/**
+ * direct convolution of image with small kernel 'kern' (kw x kh, centered at (kw/2, kh/2)),
+ * borders are mirrored like in FFT convolution;
+ * rows are processed in parallel, for each kernel element whole row is accumulated by SIMD loop
+ */
+static IMAGE *direct_convolve(IMAGE *img, const Item *kern, int kw, int kh){
+	int w = img->width, h = img->height, cx = kw / 2, cy = kh / 2;
+	// interior [x0, x1): all kernel elements are inside row
+	int x0 = kw - 1 - cx, x1 = MAX(x0, w - cx), bl = MIN(x0, w), br = MAX(x1, bl);
+	IMAGE *out = similarFITS(img, DOUBLE_IMG);
+	const Item *in = image_data(img);
+	Item *res = out->data;
+	OMP_FOR(schedule(static))
+	for(int y = 0; y < h; ++y){
+		Item *dst = &res[(size_t)y * w];
+		memset(dst, 0, sizeof(Item) * w);
+		for(int j = 0; j < kh; ++j){
+			// out(x, y) = sum kern(i, j) * in(x + cx - i, y + cy - j)
+			const Item *src = &in[(size_t)mirror_idx(y + cy - j, h) * w];
+			for(int i = 0; i < kw; ++i){
+				Item k = kern[j * kw + i];
+				if(k == 0.) continue;
+				const Item *s = src + cx - i;
+				OMP_SIMD()
+				for(int x = x0; x < x1; ++x) dst[x] += k * s[x];
+				for(int x = 0; x < bl; ++x) dst[x] += k * src[mirror_idx(x + cx - i, w)];
+				for(int x = br; x < w; ++x) dst[x] += k * src[mirror_idx(x + cx - i, w)];
+			}
+		}
+	}
+	return out;
+}
+
+/**
+ * filter image by direct convolution with kernel kw x kh; result is the same as of FFT convolution
+ * with array nx x ny
+ */
+static IMAGE *direct_filter(IMAGE *img, Filter *f, int kw, int kh, int nx, int ny){
+	Item *kern = build_mask(kw, kh, f);
+	double norm = (double)kw * kh; // masks are normalized for FFT of their size
+	if(f->FilterType == LAPGAUSS) // LoG normalization depends on array size
+		norm *= pow(norm / ((double)nx * ny), 0.25);
+	for(int i = 0; i < kw * kh; ++i) kern[i] *= norm;
+	IMAGE *out = direct_convolve(img, kern, kw, kh);
+	fftw_free(kern);
+	return out;
+}
+
+// images with padded FFT larger than this (pixels) are convolved by tiles
+#define FFT_MAX_AREA	(1 << 24)
+// minimal size of tile FFT; it also should be not less than FFT_TILE_KERN kernel sizes
+#define FFT_TILE		(512)
+#define FFT_TILE_KERN	(4)
+
+/**
+ * size of tile FFT for kernel kw x kh or 0 if image (padded to nx x ny) should be convolved at once
+ */
+static int tile_size(int kw, int kh, int nx, int ny){
+	if((double)nx * ny <= FFT_MAX_AREA) return 0;
+	int T = fft_size(MAX(FFT_TILE, FFT_TILE_KERN * MAX(kw, kh)));
+	if(4. * T * T > (double)nx * ny) return 0; // too few tiles
+	return T;
+}
+
+/**
+ * overlap-save convolution by tiles T x T (kernel kw x kh, image padded to nx x ny for whole FFT):
+ * each tile gives (T - kw + 1) x (T - kh + 1) pixels of result, tiles are processed in parallel
+ * with the same single-thread plans, so memory is bounded by two tile buffers per thread;
+ * margins of tiles are equal to window, so mask is always truncated by it
+ */
+static IMAGE *tiled_filter(IMAGE *img, Filter *f, int kw, int kh, int nx, int ny, int T){
+	#ifdef EBUG
+	double t0 = dtime();
+	#endif
+	int w = img->width, h = img->height;
+	// margins of input tile: out(x) = sum mask(d) * in(x - d), -kw/2 <= d < kw - kw/2
+	int lx = kw - 1 - kw/2, ly = kh - 1 - kh/2;
+	int bw = T - kw + 1, bh = T - kh + 1, ntx = (w + bw - 1) / bw, nty = (h + bh - 1) / bh;
+	size_t csize = (size_t)T * (T/2 + 1);
+	fftw_plan fwd = get_plan_nth(T, T, FALSE, 1), inv = get_plan_nth(T, T, TRUE, 1);
+	if(!fwd || !inv){
+		put_plan(fwd);
+		put_plan(inv);
+		return NULL;
+	}
+	fftw_complex *Fmask = fft_alloc(sizeof(fftw_complex) * csize, FALSE);
+	Item *mask = build_mask(T, T, f);
+	fftw_execute_dft_r2c(fwd, mask, Fmask);
+	fftw_free(mask);
+	int sh = T / 2; // position of mask center in tile
+	if(f->FilterType == LAPGAUSS){ // the same normalization as for whole image
+		double scale = pow((double)T * T / ((double)nx * ny), 0.25);
+		OMP_FOR()
+		for(size_t i = 0; i < csize; ++i){
+			Fmask[i][0] *= scale;
+			Fmask[i][1] *= scale;
+		}
+	}
+	DBG("%d x %d tiles %d x %d, time=%f\n", ntx, nty, T, T, dtime()-t0);
+	IMAGE *out = similarFITS(img, DOUBLE_IMG);
+	const Item *in = image_data(img);
+	Item *res = out->data;
+	OMP_FOR(schedule(dynamic))
+	for(int t = 0; t < ntx * nty; ++t){
+		int X0 = (t % ntx) * bw, Y0 = (t / ntx) * bh;
+		int ow = MIN(bw, w - X0), oh = MIN(bh, h - Y0), iw = ow + kw - 1, ih = oh + kh - 1;
+		// part of tile inside image by x
+		int xa = MIN(MAX(0, lx - X0), iw), xb = MAX(xa, MIN(iw, w - X0 + lx));
+		Item *buf = fft_alloc(sizeof(Item) * T * T, TRUE);
+		fftw_complex *F = fft_alloc(sizeof(fftw_complex) * csize, FALSE);
+		for(int j = 0; j < ih; ++j){ // input with margins, mirrored outside of image
+			const Item *src = &in[(size_t)mirror_idx(Y0 - ly + j, h) * w];
+			Item *dst = &buf[(size_t)j * T];
+			memcpy(dst + xa, src + X0 - lx + xa, sizeof(Item) * (xb - xa));
+			for(int i = 0; i < xa; ++i) dst[i] = src[mirror_idx(X0 - lx + i, w)];
+			for(int i = xb; i < iw; ++i) dst[i] = src[mirror_idx(X0 - lx + i, w)];
+		}
+		fftw_execute_dft_r2c(fwd, buf, F);
+		OMP_SIMD()
+		for(size_t i = 0; i < csize; ++i){
+			Item a = F[i][0], b = F[i][1], c = Fmask[i][0], d = Fmask[i][1];
+			F[i][0] = a*c - b*d;
+			F[i][1] = b*c + a*d;
+		}
+		fftw_execute_dft_c2r(inv, F, buf);
+		for(int y = 0; y < oh; ++y){ // valid part of circular convolution
+			const Item *src = &buf[(size_t)((ly + y + sh) % T) * T];
+			Item *dst = &res[(size_t)(Y0 + y) * w + X0];
+			for(int x = 0; x < ow; ++x) dst[x] = src[(lx + x + sh) % T];
 		}
+		fftw_free(F);
+		fftw_free(buf);
 	}
+	fftw_free(Fmask);
+	put_plan(fwd);
+	put_plan(inv);
 	DBG("time=%f\n", dtime()-t0);
-	return mask;
+	return out;
 }
 
 /*
@@ -212,102 +596,67 @@ Item *build_S_filter(int size, Filter *f){
  * Returns NULL on error or converted image
  */
 IMAGE *DiffFilter(IMAGE *img, Filter *f, _U_ Itmarray *u){
-	int ssize;
-	static int fftw_ini = 0;
 	int sizex = img->width, sizey = img->height;
-	size_t blklen = sizex * sizeof(Item);
-	int size2 = nextpow2(sizex, sizey);
+	// each axis is padded by kernel support
+	int kw = 3, kh = 3;
+	if(f->FilterType == LAPGAUSS || f->FilterType == GAUSS){
+		kw = f->w; kh = f->h;
+	}
+	int nx = fft_size(sizex + kw), ny = fft_size(sizey + kh);
+	// spectra of Gaussian & LoG are known if their window isn't truncated
+	bool analytic = (f->FilterType == LAPGAUSS || f->FilterType == GAUSS) && whole_gaussian(f);
+	// small kernels: direct convolution is cheaper (if spectrum of image isn't computed yet)
+	imgspectrum *sp = img->spectrum;
+	bool havespec = sp && sp->nx == nx && sp->ny == ny;
+	if(direct_cheaper(sizex, sizey, kw, kh, nx, ny, (havespec ? 1 : 2) + (analytic ? 0 : 1)))
+		return direct_filter(img, f, kw, kh, nx, ny);
+	// large images: FFT by tiles (if spectrum of whole image isn't computed yet)
+	int T = havespec ? 0 : tile_size(kw, kh, nx, ny);
+	if(T) return tiled_filter(img, f, kw, kh, nx, ny, T);
 	#ifdef EBUG
 	double t0 = dtime();
 	#endif
-	// build filter
-	Item *mask;
-	switch(f->FilterType){
-		case LAPGAUSS:
-			mask = build_LG_filter(size2, f);
-		break;
-		case GAUSS:
-			mask = build_G_filter(size2, f);
-		break;
-		default:
-			mask = build_S_filter(size2, f);
-	}
 	IMAGE *out = similarFITS(img, DOUBLE_IMG);
-	Item *res = out->data, *inputima = img->data;
-	ssize = size2 * size2; // FFT image size
-	if(!fftw_ini)
-		if(!(fftw_ini = fftw_init_threads())){
-			WARN(_("FFTW error"));
-			return NULL;
-		}
-	DBG("img (%d x %d) -> (%d x %d), time=%f\n", sizex,sizey, size2,size2, dtime()-t0);
-	// allocate memory for objects
-	Item *ima = MALLOC(Item, ssize);
-	fftw_complex *Fimg = MALLOC(fftw_complex, ssize);
-	// define direct FFT
-	fftw_plan_with_nthreads(THREAD_NUMBER);
-	fftw_plan fftimg = fftw_plan_dft_r2c_2d(size2, size2, ima, Fimg, FFTW_ESTIMATE);
-	// copy ima -> img
-	OMP_FOR(shared(ima, inputima))
-	for(int j = 0; j < sizey; j++){
-		int k = j * size2, l = j * sizex;
-		memcpy(&ima[k], &inputima[l], blklen); // main image
-	}
-	int diff = size2 - sizey;
-	if(diff){
-		OMP_FOR(shared(ima, inputima))
-		for(int j = 0; j < diff; ++j){
-			int k = (j + sizey)* size2, l = (sizey - 1 - j) * sizex;
-			memcpy(&ima[k], &inputima[l], blklen); // lower left subimage (mirrored vertically)
-		}
+	size_t ssize = (size_t)nx * ny; // FFT image size
+	size_t csize = (size_t)ny * (nx/2 + 1); // size of r2c transform
+	fftw_plan fftmask = get_plan(ny, nx, FALSE), ifft = get_plan(ny, nx, TRUE);
+	fftw_complex *Fimg = image_spectrum(img, nx, ny);
+	if(!fftmask || !ifft || !Fimg){
+		put_plan(fftmask);
+		put_plan(ifft);
+		imfree(&out);
+		return NULL;
 	}
-	// the rest: right subimages (mirrored by x)
-	diff = size2 - sizex;
-	if(diff){
-		OMP_FOR(shared(ima))
-		for(int j = 0; j < size2; ++j){
-			int l = j * size2 + sizex, k = l - 1;
-			for(int i = 0; i < diff; ++i, --k, ++l)
-				ima[l] = ima[k];
+	DBG("img (%d x %d) -> (%d x %d), time=%f\n", sizex,sizey, nx,ny, dtime()-t0);
+	fftw_complex *Fmask = fft_alloc(sizeof(fftw_complex) * csize, FALSE);
+	if(analytic){
+		kernel_spectrum_mul(Fimg, Fmask, nx, ny, f);
+	}else{
+		// build filter
+		Item *mask = build_mask(nx, ny, f);
+		// filter FFT
+		fftw_execute_dft_r2c(fftmask, mask, Fmask);
+		fftw_free(mask);
+		// filtered picture:
+		DBG("filter image, time=%f\n", dtime()-t0);
+		OMP_FOR(shared(Fmask, Fimg))
+		for(size_t i = 0; i < csize; i++){ // convolution by multiplication in Fourier space
+			Item a, b, c, d;
+			a = Fimg[i][0]; c = Fmask[i][0];
+			b = Fimg[i][1]; d = Fmask[i][1];
+			Fmask[i][0] = a*c - b*d; // spectrum of image is kept for next filters
+			Fmask[i][1] = b*c + a*d;
 		}
 	}
-	fftw_execute(fftimg); // now Fimg is fourier transform of input image
-	FREE(ima); // we don't need in anymore
-	// define filter FFT
-	fftw_plan_with_nthreads(THREAD_NUMBER);
-	fftw_complex *Fmask = MALLOC(fftw_complex, ssize);
-	fftw_plan fftmask = fftw_plan_dft_r2c_2d(size2, size2, mask, Fmask, FFTW_ESTIMATE);
-	fftw_execute(fftmask);
-	FREE(mask);
-	DBG("here");
-	// filtered picture:
-	DBG("filter image, time=%f\n", dtime()-t0);
-	Item *resm = MALLOC(Item, ssize);
-	OMP_FOR(shared(Fmask, Fimg))
-	for(int i = 0; i < ssize; i++){ // convolution by multiplication in Fourier space
-		Item a, b, c, d;
-		a = Fimg[i][0]; c = Fmask[i][0];
-		b = Fimg[i][1]; d = Fmask[i][1];
-		Fimg[i][0] = a*c - b*d;
-		Fimg[i][1] = b*c + a*d;
-	}
-	FREE(Fmask);
-	// define inverse FFT
-	fftw_plan_with_nthreads(THREAD_NUMBER);
-	fftw_plan ifft = fftw_plan_dft_c2r_2d(size2, size2, Fimg, resm, FFTW_ESTIMATE);
-	fftw_execute(ifft);
-	FREE(Fimg);
-	fftshift(size2, resm);
-	OMP_FOR(shared(res, resm))
-	for(int j = 0; j < sizey; j++){
-		int k = j * size2, l = j * sizex;
-		memcpy(&res[l], &resm[k], blklen);
-	}
-	FREE(resm);
-	fftw_destroy_plan(fftimg);
-	fftw_destroy_plan(ifft);
-	fftw_destroy_plan(fftmask);
-	fftw_cleanup_threads();
+	Item *resm = fft_alloc(sizeof(Item) * ssize, FALSE);
+	fftw_execute_dft_c2r(ifft, Fmask, resm);
+	put_plan(fftmask);
+	put_plan(ifft);
+	fftw_free(Fmask);
+	// masks are centered at (nx/2, ny/2), analytic spectra - at zero
+	if(analytic) fftshift(resm, nx, ny, 0, 0, out->data, sizex, sizey);
+	else fftshift(resm, nx, ny, nx/2, ny/2, out->data, sizex, sizey);
+	fftw_free(resm);
 	DBG("time=%f\n", dtime()-t0);
 	return out;
 }
@@ -320,7 +669,7 @@ IMAGE *GradFilterSimple(IMAGE *img, _U_ Filter *fu, _U_ Itmarray *u){
 	#ifdef EBUG
 	double t0 = dtime();
 	#endif
-	Filter f;
+	Filter f = {0};
 	f.FilterType = SOBELH;
 	IMAGE *horiz = DiffFilter(img, &f, NULL);
 	f.FilterType = SOBELV;
@@ -338,3 +687,194 @@ IMAGE *GradFilterSimple(IMAGE *img, _U_ Filter *fu, _U_ Itmarray *u){
 	DBG("time=%f\n", dtime()-t0);
 	return horiz;
 }
+
+gaussmethodpairs gauss_methods[] = {
+	{GAUSS_AUTO,      "auto"},
+	{GAUSS_FFT,       "fft"},
+	{GAUSS_SEPARABLE, "sep"},
+	{GAUSS_RECURSIVE, "iir"},
+	{0, NULL}
+};
+
+// rows filtered at once by one thread (& size of tiles when they are transposed)
+#define GAUSS_BLOCK			(32)
+// recursive filter is used by default for sigma not less than this value (if window isn't truncated)
+#define GAUSS_IIR_SIGMA		(3.)
+
+// 1-D Gaussian for filtering of lines
+typedef struct{
+	bool recursive;		// IIR (TRUE) or convolution with kernel
+	Item *kern;			// kernel (kw elements, centered at kw/2)
+	int kw;
+	Item n[4], m[4], d[4];	// recursive filter: causal & anticausal numerators, common denominator
+	int lpad, rpad;		// amount of mirrored pixels added to line at the left & right
+} gauss1d;
+
+/**
+ * fill 1-D Gaussian with sigma 's' & window 'wsz' (as one axis of 2-D mask built by build_G_filter)
+ */
+static void gauss1d_init(gauss1d *g, double s, int wsz, bool recursive){
+	memset(g, 0, sizeof(gauss1d));
+	g->recursive = recursive;
+	if(recursive){
+		// 4th order filter: R. Deriche, "Recursively implementing the Gaussian and its derivatives",
+		// INRIA research report 1893 (1993); impulse response for n >= 0 is
+		// (a0 cos(w0 n) + a1 sin(w0 n)) exp(-b0 n) + (c0 cos(w1 n) + c1 sin(w1 n)) exp(-b1 n)
+		const double a0 = 1.68, a1 = 3.735, b0 = 1.783 / s, w0 = 0.6318 / s;
+		const double c0 = -0.6803, c1 = -0.2598, b1 = 1.723 / s, w1 = 1.997 / s;
+		double e0 = exp(-b0), e1 = exp(-b1), cw0 = cos(w0), sw0 = sin(w0), cw1 = cos(w1), sw1 = sin(w1);
+		double n[4], d[4], m[4], sn = 0., sm = 0., sd = 1.;
+		n[0] = a0 + c0;
+		n[1] = e1 * (c1 * sw1 - (c0 + 2. * a0) * cw1) + e0 * (a1 * sw0 - (2. * c0 + a0) * cw0);
+		n[2] = 2. * e0 * e1 * ((a0 + c0) * cw1 * cw0 - a1 * cw1 * sw0 - c1 * cw0 * sw1)
+			+ c0 * e0 * e0 + a0 * e1 * e1;
+		n[3] = e1 * e0 * e0 * (c1 * sw1 - c0 * cw1) + e0 * e1 * e1 * (a1 * sw0 - a0 * cw0);
+		d[0] = -2. * e1 * cw1 - 2. * e0 * cw0;
+		d[1] = 4. * cw1 * cw0 * e0 * e1 + e1 * e1 + e0 * e0;
+		d[2] = -2. * cw0 * e0 * e1 * e1 - 2. * cw1 * e1 * e0 * e0;
+		d[3] = e0 * e0 * e1 * e1;
+		for(int i = 0; i < 3; ++i) m[i] = n[i + 1] - d[i] * n[0];
+		m[3] = -d[3] * n[0];
+		for(int i = 0; i < 4; ++i){
+			sn += n[i]; sm += m[i]; sd += d[i];
+		}
+		double norm = sd / (sn + sm); // unit gain for constant signal
+		for(int i = 0; i < 4; ++i){
+			g->n[i] = n[i] * norm;
+			g->m[i] = m[i] * norm;
+			g->d[i] = d[i];
+		}
+		// line is extended by mirrored pixels until response decays, so start from steady state
+		// of its end pixels is good enough
+		g->lpad = g->rpad = (int)ceil(GAUSS_WINDOW * s);
+		return;
+	}
+	int c = wsz / 2;
+	double ss = 1. / sqrt(2. * M_PI) / s, s2 = s * s;
+	g->kw = wsz;
+	g->kern = MALLOC(Item, wsz);
+	for(int i = 0; i < wsz; ++i){
+		double d = i - c;
+		g->kern[i] = ss * exp(-d * d / s2 / 2.);
+	}
+	g->lpad = wsz - 1 - c;
+	g->rpad = c;
+}
+
+/**
+ * filter line 'in' of length 'n' into 'out', borders are mirrored
+ * @param buf - buffer for 2 * (n + lpad + rpad) items
+ */
+static void gauss1d_line(const gauss1d *g, const Item *in, Item *out, int n, Item *buf){
+	int l = g->lpad, len = n + l + g->rpad;
+	memcpy(buf + l, in, sizeof(Item) * n);
+	for(int j = 0; j < l; ++j) buf[j] = in[mirror_idx(j - l, n)];
+	for(int j = l + n; j < len; ++j) buf[j] = in[mirror_idx(j - l, n)];
+	if(!g->recursive){ // out(x) = sum kern(i) * in(x + c - i)
+		memset(out, 0, sizeof(Item) * n);
+		for(int i = 0; i < g->kw; ++i){
+			Item k = g->kern[i];
+			const Item *s = buf + g->kw - 1 - i;
+			OMP_SIMD()
+			for(int x = 0; x < n; ++x) out[x] += k * s[x];
+		}
+		return;
+	}
+	const Item *N = g->n, *M = g->m, *D = g->d;
+	Item *y = buf + len, sd = 1. + D[0] + D[1] + D[2] + D[3];
+	// causal part: y(k) = sum N(i) x(k-i) - sum D(i) y(k-i-1)
+	Item x0 = buf[0], x1 = x0, x2 = x0, x3 = x0;
+	Item y0 = x0 * (N[0] + N[1] + N[2] + N[3]) / sd, y1 = y0, y2 = y0, y3 = y0;
+	for(int k = 0; k < len; ++k){
+		x3 = x2; x2 = x1; x1 = x0; x0 = buf[k];
+		Item v = N[0]*x0 + N[1]*x1 + N[2]*x2 + N[3]*x3 - D[0]*y0 - D[1]*y1 - D[2]*y2 - D[3]*y3;
+		y3 = y2; y2 = y1; y1 = y0; y[k] = y0 = v;
+	}
+	// anticausal part: y(k) = sum M(i) x(k+i+1) - sum D(i) y(k+i+1), added to causal
+	x0 = x1 = x2 = x3 = buf[len - 1];
+	y0 = x0 * (M[0] + M[1] + M[2] + M[3]) / sd; y1 = y2 = y3 = y0;
+	for(int k = len - 1; k >= 0; --k){
+		Item v = M[0]*x0 + M[1]*x1 + M[2]*x2 + M[3]*x3 - D[0]*y0 - D[1]*y1 - D[2]*y2 - D[3]*y3;
+		x3 = x2; x2 = x1; x1 = x0; x0 = buf[k];
+		y3 = y2; y2 = y1; y1 = y0; y0 = v;
+		y[k] += v;
+	}
+	memcpy(out, y + l, sizeof(Item) * n);
+}
+
+/**
+ * filter rows of w x h array 'in' & write them transposed into 'out' (h x w):
+ * blocks of GAUSS_BLOCK rows are filtered in parallel & written by GAUSS_BLOCK^2 tiles,
+ * so the next pass also goes along rows
+ */
+static void gauss_pass(const gauss1d *g, const Item *in, Item *out, int w, int h){
+	OMP_FOR(schedule(dynamic))
+	for(int y0 = 0; y0 < h; y0 += GAUSS_BLOCK){
+		int nr = MIN(GAUSS_BLOCK, h - y0);
+		Item *blk = MALLOC(Item, (size_t)nr * w);
+		Item *buf = MALLOC(Item, 2 * (w + g->lpad + g->rpad));
+		for(int j = 0; j < nr; ++j)
+			gauss1d_line(g, &in[(size_t)(y0 + j) * w], &blk[(size_t)j * w], w, buf);
+		for(int x0 = 0; x0 < w; x0 += GAUSS_BLOCK){
+			int x1 = MIN(x0 + GAUSS_BLOCK, w);
+			for(int x = x0; x < x1; ++x){
+				Item *dst = &out[(size_t)x * h + y0];
+				for(int j = 0; j < nr; ++j) dst[j] = blk[(size_t)j * w + x];
+			}
+		}
+		FREE(buf);
+		FREE(blk);
+	}
+}
+
+/**
+ * Gaussian by two 1-D passes (convolution with kernels or recursive filter)
+ */
+static IMAGE *gauss_separable(IMAGE *img, Filter *f, bool recursive){
+	#ifdef EBUG
+	double t0 = dtime();
+	#endif
+	int w = img->width, h = img->height;
+	gauss1d gx, gy;
+	gauss1d_init(&gx, f->sx, f->w, recursive);
+	gauss1d_init(&gy, f->sy, f->h, recursive);
+	IMAGE *out = similarFITS(img, DOUBLE_IMG);
+	Item *tmp = MALLOC(Item, (size_t)w * h);
+	gauss_pass(&gx, image_data(img), tmp, w, h);
+	gauss_pass(&gy, tmp, out->data, h, w);
+	FREE(tmp);
+	FREE(gx.kern);
+	FREE(gy.kern);
+	DBG("%s gaussian, time=%f\n", recursive ? "recursive" : "separable", dtime()-t0);
+	return out;
+}
+
+/*
+ * Gaussian filter: 2-D convolution, two 1-D convolutions or recursive filter
+ * (by f->method; for GAUSS_AUTO IIR is used for large sigma with window covering
+ * the whole Gaussian, separable convolution - when it is cheaper than FFT)
+ */
+IMAGE *GaussFilter(IMAGE *img, Filter *f, _U_ Itmarray *u){
+	GaussMethod m = f->method;
+	if(m == GAUSS_AUTO){
+		if(MIN(f->sx, f->sy) >= GAUSS_IIR_SIGMA && whole_gaussian(f)) m = GAUSS_RECURSIVE;
+		else{
+			int nx = fft_size(img->width + f->w), ny = fft_size(img->height + f->h);
+			imgspectrum *sp = img->spectrum;
+			bool havespec = sp && sp->nx == nx && sp->ny == ny;
+			// kw + kh multiply-adds per pixel
+			m = direct_cheaper(img->width, img->height, f->w + f->h, 1, nx, ny,
+					(havespec ? 1 : 2) + (whole_gaussian(f) ? 0 : 1)) ?
+				GAUSS_SEPARABLE : GAUSS_FFT;
+		}
+	}
+	DBG("Gaussian method: %d", m);
+	switch(m){
+		case GAUSS_SEPARABLE:
+			return gauss_separable(img, f, FALSE);
+		case GAUSS_RECURSIVE:
+			return gauss_separable(img, f, TRUE);
+		default:
+			return DiffFilter(img, f, NULL);
+	}
+}
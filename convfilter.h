@@ -25,7 +25,24 @@
 #include "types.h"
 #include "fits.h"
 
+// f->method for Gaussian filter
+typedef enum{
+	 GAUSS_AUTO = 0		// choose by window, sigma & image size
+	,GAUSS_FFT			// 2-D convolution with window (FFT or direct)
+	,GAUSS_SEPARABLE	// two 1-D convolutions
+	,GAUSS_RECURSIVE	// recursive (IIR) filter, window is ignored
+} GaussMethod;
+
+typedef struct{
+	GaussMethod method;
+	char *name;
+} gaussmethodpairs;
+
+extern gaussmethodpairs gauss_methods[];
+
 IMAGE *DiffFilter(IMAGE *img, Filter *f, Itmarray *u);
 IMAGE *GradFilterSimple(IMAGE *img, Filter *f, Itmarray *u);
+IMAGE *GaussFilter(IMAGE *img, Filter *f, Itmarray *u);
+bool fftw_set_planner(char *mode, char *wisdom);
 
 #endif // __GRADIENT_H__
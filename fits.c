@@ -20,14 +20,24 @@
  */
 
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include "fits.h"
 #include "types.h"
 #include "usefull_macros.h"
 #include "cmdlnopts.h"
+#include "pixtypes.h"
+#include "fitscomp.h"
+#include "fitsmmap.h"
 
-static int fitsstatus = 0;
+static __thread int fitsstatus = 0; // files could be processed in parallel (batch mode)
+
+#define FITS_BLOCK      (2880)          // size of FITS block
+#define MEMOUT_CHUNK    (FITS_BLOCK * 1024) // increment of memory buffer for output into stdout
 
 /*
  * Macros for error processing when working with cfitsio functions
@@ -54,182 +64,283 @@ do{ fitsstatus = 0;                             \
     if(status) fits_report_error(stderr, status);\
 }while(0)
 
-KeyList *list_get_end(KeyList *list){
-    if(!list) return NULL;
-    KeyList *first = list;
-    if(list->last) return list->last;
-    while(list->next) list = list->next;
-    //while(first->next){
-        first->last = list;
-    /*  first = first->next;
-    }*/
-    return list;
-}
-
-/**
- * add record to keylist
- * @param list (io) - pointer to root of list or NULL
- *                      if *root == NULL, just created node will be placed there
- * @param rec       - data inserted
- * @return pointer to created node
- */
-KeyList *list_add_record(KeyList **list, char *rec){
-    KeyList *node, *last;
-    if((node = (KeyList*) MALLOC(KeyList, 1)) == 0)  return NULL; // allocation error
-    node->record = strdup(rec); // insert data
-    if(!node->record){
-        /// "   "
-        WARNX(_("Can't copy data"));
-        return NULL;
+// initial sizes of header arena & hash table
+#define KEYLIST_NCARDS  (64)
+#define KEYLIST_ISIZE   (128)
+// special values of KeyIndex.name
+#define KEYINDEX_EMPTY      (-1)
+#define KEYINDEX_REMOVED    (-2)
+
+/**
+ * length of keyword of card 'rec': text before '=' for HIERARCH cards,
+ * else first (up to 8) characters before space or '='
+ */
+static int card_keylen(const char *rec){
+    int l = 0;
+    if(strncmp(rec, "HIERARCH ", 9) == 0){
+        const char *eq = strchr(rec, '=');
+        if(eq){
+            l = eq - rec;
+            while(l > 0 && rec[l-1] == ' ') --l;
+            return l;
+        }
     }
-    if(list){
-        if(*list){ // there was root node - search last
-            last = list_get_end(*list);
-            last->next = node; // insert pointer to new node into last element in list
-            (*list)->last = node;
-        //  DBG("last node %s", (*list)->last->record);
-        }else *list = node;
+    while(l < 8 && rec[l] && rec[l] != ' ' && rec[l] != '=') ++l;
+    return l;
+}
+
+// FNV-1a hash of keyword
+static uint32_t key_hash(const char *key, int len){
+    uint32_t h = 2166136261u;
+    for(int i = 0; i < len; ++i){
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
     }
-    return node;
+    return h;
 }
 
 /**
- * return record with given key or NULL
+ * find hash table entry for keyword 'key' of length 'len'
+ * @return entry found or empty entry where it should be placed
  */
-KeyList *list_find_key(KeyList *list, char *key){
-    if(!list || !key) return NULL;
-    size_t L = strlen(key);
-    do{
-        if(list->record){
-            if(strncmp(list->record, key, L) == 0){ // key found
-                return list;
-            }
+static KeyIndex *index_find(KeyList *list, const char *key, int len, uint32_t h){
+    int mask = list->isize - 1, i = h & mask;
+    KeyIndex *idx = list->index;
+    while(idx[i].name != KEYINDEX_EMPTY){
+        if(idx[i].name != KEYINDEX_REMOVED && idx[i].hash == h){
+            KeyCard *c = &list->cards[idx[i].name];
+            if(c->keylen == len && strncmp(c->record, key, len) == 0) break;
         }
-        list = list->next;
-    }while(list);
-    return NULL;
+        i = (i + 1) & mask;
+    }
+    return &idx[i];
+}
+
+/**
+ * append card number 'n' to the end of chain of its keyword
+ */
+static void index_add(KeyList *list, int n){
+    KeyCard *c = &list->cards[n];
+    uint32_t h = key_hash(c->record, c->keylen);
+    KeyIndex *e = index_find(list, c->record, c->keylen, h);
+    c->next = -1;
+    if(e->name == KEYINDEX_EMPTY){
+        e->hash = h;
+        e->name = n;
+        ++list->iused;
+    }else list->cards[e->last].next = n;
+    e->last = n;
+}
+
+/**
+ * build hash table of size 'isize' from scratch (only actual cards are indexed)
+ */
+static void index_rebuild(KeyList *list, int isize){
+    FREE(list->index);
+    list->index = MALLOC(KeyIndex, isize);
+    list->isize = isize;
+    list->iused = 0;
+    for(int i = 0; i < isize; ++i) list->index[i].name = KEYINDEX_EMPTY;
+    for(int n = 0; n < list->ncards; ++n)
+        if(!list->cards[n].deleted) index_add(list, n);
+}
+
+/**
+ * get hash table entry of user given keyword 'key' (trailing spaces are ignored)
+ * @return NULL if there's no such keyword in header
+ */
+static KeyIndex *key_entry(KeyList *list, const char *key){
+    if(!list || !key || !list->index) return NULL;
+    int len = strlen(key);
+    while(len > 0 && key[len-1] == ' ') --len;
+    KeyIndex *e = index_find(list, key, len, key_hash(key, len));
+    if(e->name == KEYINDEX_EMPTY) return NULL;
+    return e;
+}
+
+/**
+ * add record to the end of header
+ * @param list (io) - pointer to header or to NULL (then new header will be created)
+ * @param rec       - card text (truncated to 80 characters)
+ * @return pointer to copy of record in header (valid until next addition)
+ */
+char *list_add_record(KeyList **list, char *rec){
+    if(!list || !rec) return NULL;
+    KeyList *l = *list;
+    if(!l){
+        l = *list = MALLOC(KeyList, 1);
+        l->nalloc = KEYLIST_NCARDS;
+        l->cards = MALLOC(KeyCard, l->nalloc);
+        index_rebuild(l, KEYLIST_ISIZE);
+    }
+    if(l->ncards == l->nalloc){
+        KeyCard *cards = realloc(l->cards, sizeof(KeyCard) * l->nalloc * 2);
+        if(!cards){ // old cards stay in place
+            /// "   "
+            WARNX(_("Can't copy data"));
+            return NULL;
+        }
+        l->cards = cards;
+        l->nalloc *= 2;
+    }
+    int n = l->ncards++;
+    KeyCard *c = &l->cards[n];
+    snprintf(c->record, FLEN_CARD, "%s", rec);
+    c->keylen = card_keylen(c->record);
+    c->deleted = FALSE;
+    if(2 * (l->iused + 1) > l->isize) index_rebuild(l, l->isize * 2);
+    else index_add(l, n);
+    return c->record;
 }
 
 /**
- * modify key value
+ * return first record with exactly given keyword or NULL
+ */
+char *list_find_key(KeyList *list, char *key){
+    KeyIndex *e = key_entry(list, key);
+    if(!e) return NULL;
+    return list->cards[e->name].record;
+}
+
+/**
+ * modify value of first record with given key
  * return NULL if given key is absent
  */
-KeyList *list_modify_key(KeyList *list, char *key, char *newval){
+char *list_modify_key(KeyList *list, char *key, char *newval){
     char buf[FLEN_CARD];
-    KeyList *rec = list_find_key(list, key);
-    if(!rec) return NULL;
-    char *comm = strchr(rec->record, '/');
+    KeyIndex *e = key_entry(list, key);
+    if(!e) return NULL;
+    KeyCard *c = &list->cards[e->name];
+    char *comm = strchr(c->record, '/');
     if(!comm) comm = "";
     snprintf(buf, FLEN_CARD, "%-8s=%21s %s", key, newval, comm);
-    FREE(rec->record);
-    rec->record = strdup(buf);
-    return rec;
+    memcpy(c->record, buf, FLEN_CARD);
+    c->keylen = card_keylen(c->record);
+    return c->record;
 }
 
 /**
- * remove record by key
+ * remove all records with given key
  */
 void list_remove_key(KeyList **keylist, char *key){
-    if(!keylist || !key) return;
-    size_t L = strlen(key);
-    KeyList *prev = NULL, *list = *keylist, *last = list_get_end(list);
-    do{
-        if(list->record){
-            if(strncmp(list->record, key, L) == 0){ // key found
-                if(prev){ // not first record
-                    prev->next = list->next;
-                }else{ // first or only record
-                    if(*keylist == last){
-                        *keylist = NULL; // the only record - erase it
-                    }else{ // first record - modyfy heading record
-                        *keylist = list->next;
-                        (*keylist)->last = last;
-                    }
-                }
-                DBG("remove record by key \"%s\":\n%s",key, list->record);
-                FREE(list->record);
-                FREE(list);
-                return;
-            }
-        }
-        prev = list;
-        list = list->next;
-    }while(list);
+    if(!keylist) return;
+    KeyList *list = *keylist;
+    KeyIndex *e = key_entry(list, key);
+    if(!e) return;
+    for(int n = e->name; n > -1; n = list->cards[n].next){
+        DBG("remove record by key \"%s\":\n%s", key, list->cards[n].record);
+        list->cards[n].deleted = TRUE;
+        ++list->ndeleted;
+    }
+    // entry stays occupied (it could be in probe sequence of other keys)
+    e->name = e->last = KEYINDEX_REMOVED;
 }
+
 /**
  * remove records by any sample
  */
 void list_remove_records(KeyList **keylist, char *sample){
-    if(!keylist || !sample) return;
-    KeyList *prev = NULL, *list = *keylist, *last = list_get_end(list);
+    if(!keylist || !*keylist || !sample) return;
+    KeyList *list = *keylist;
+    int n, removed = 0;
     DBG("remove %s", sample);
-    do{
-        if(list->record){
-            if(strstr(list->record, sample)){ // key found
-                if(prev){
-                    prev->next = list->next;
-                }else{
-                    if(*keylist == last){
-                        *keylist = NULL; // the only record - erase it
-                    }else{ // first record - modyfy heading record
-                        *keylist = list->next;
-                        (*keylist)->last = last;
-                    }
-                }
-                KeyList *tmp = list->next;
-                FREE(list->record);
-                FREE(list);
-                list = tmp;
-                continue;
-            }
-        }
-        prev = list;
-        list = list->next;
-    }while(list);
+    for(n = 0; n < list->ncards; ++n){
+        KeyCard *c = &list->cards[n];
+        if(c->deleted || !strstr(c->record, sample)) continue;
+        c->deleted = TRUE;
+        ++removed;
+    }
+    if(!removed) return;
+    list->ndeleted += removed;
+    index_rebuild(list, list->isize);
 }
+
 /**
  * free list memory & set it to NULL
  */
 void list_free(KeyList **list){
-    KeyList *node = *list, *next;
     if(!list || !*list) return;
-    do{
-        next = node->next;
-        FREE(node->record);
-        free(node);
-        node = next;
-    }while(node);
-    *list = NULL;
+    FREE((*list)->cards);
+    FREE((*list)->index);
+    FREE(*list);
 }
+
 /**
- * make a full copy of given list
+ * make a full copy of given list (removed cards are dropped)
  */
 KeyList *list_copy(KeyList *list){
     if(!list) return NULL;
-    KeyList *newlist = NULL;
-    #ifdef EBUG
-    int n = 0;
-    #endif
-    do{
-        list_add_record(&newlist, list->record);
-        list = list->next;
-        #ifdef EBUG
-        ++n;
-        #endif
-    }while(list);
-    DBG("copy list of %d entries", n);
+    KeyList *newlist = MALLOC(KeyList, 1);
+    int n, N = list->ncards - list->ndeleted;
+    newlist->nalloc = MAX(N, KEYLIST_NCARDS);
+    newlist->cards = MALLOC(KeyCard, newlist->nalloc);
+    if(list->ndeleted == 0){ // just copy arena & index
+        memcpy(newlist->cards, list->cards, sizeof(KeyCard) * N);
+        newlist->ncards = N;
+        newlist->isize = list->isize;
+        newlist->iused = list->iused;
+        newlist->index = MALLOC(KeyIndex, list->isize);
+        memcpy(newlist->index, list->index, sizeof(KeyIndex) * list->isize);
+    }else{
+        for(n = 0; n < list->ncards; ++n)
+            if(!list->cards[n].deleted) newlist->cards[newlist->ncards++] = list->cards[n];
+        index_rebuild(newlist, list->isize);
+    }
+    DBG("copy list of %d entries", N);
     return newlist;
 }
 
-void list_print(KeyList *list){
-    while(list){
-        printf("%s\n", list->record);
-        list = list->next;
+/**
+ * get next actual record of header
+ * @param idx (io) - index of card to start from (should be 0 for first call)
+ * @return record or NULL at the end of header
+ */
+char *list_next(KeyList *list, int *idx){
+    if(!list || !idx) return NULL;
+    while(*idx < list->ncards){
+        KeyCard *c = &list->cards[(*idx)++];
+        if(!c->deleted) return c->record;
     }
+    return NULL;
+}
+
+void list_print(KeyList *list){
+    int i = 0;
+    char *rec;
+    while((rec = list_next(list, &i))) printf("%s\n", rec);
+}
+
+/**
+ * free native pixels of image (or unmap file if they are mmap'ed)
+ */
+static void free_pix(IMAGE *img){
+    if(img->map){
+        My_munmap(img->map);
+        img->map = NULL;
+        img->pix = NULL;
+    }else FREE(img->pix);
+}
+
+/**
+ * free source of lazy loaded pixels
+ */
+void lazy_free(lazysrc **src){
+    if(!src || !*src) return;
+    if((*src)->map) My_munmap((*src)->map);
+    FREE((*src)->filename);
+    FREE(*src);
 }
 
+/**
+ * free image (and all next images of multi-extension file)
+ */
 void imfree(IMAGE **img){
+    IMAGE *next = (*img)->next;
     list_free(&(*img)->keylist);
+    list_free(&(*img)->primary);
+    lazy_free(&(*img)->lazy);
+    image_changed(*img);
+    free_pix(*img);
     FREE((*img)->data);
     if((*img)->tables){
         size_t i, N = (*img)->tables->amount;
@@ -242,6 +353,74 @@ void imfree(IMAGE **img){
         FREE((*img)->tables);
     }
     FREE(*img);
+    if(next) imfree(&next);
+}
+
+// amount of elements in one row of table column
+#define COL_NELEM(c)    ((c)->nelem > 0 ? (c)->nelem : 1)
+
+/**
+ * size of one element of column with type 'coltype' in memory
+ * (strings are stored as array of pointers)
+ * @return 0 for unsupported types
+ */
+static int col_elsize(int coltype){
+    switch(coltype){
+        case TBIT:
+        case TBYTE:
+        case TSBYTE:
+        case TLOGICAL:
+            return 1;
+        case TSTRING:
+            return sizeof(char*);
+        case TSHORT:
+        case TUSHORT:
+            return 2;
+        case TINT:
+        case TUINT:
+        case TFLOAT:
+            return 4;
+        case TLONGLONG:
+        case TDOUBLE:
+        case TCOMPLEX:
+            return 8;
+        case TDBLCOMPLEX:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * fill TFORM of column 'col' by its type & amount of elements per row
+ * @return FALSE if type is unsupported
+ */
+static bool col_format(table_column *col){
+    char code;
+    long n = COL_NELEM(col);
+    switch(col->coltype){
+        case TBIT:          code = 'X'; break;
+        case TBYTE:         code = 'B'; break;
+        case TSBYTE:        code = 'S'; break;
+        case TLOGICAL:      code = 'L'; break;
+        case TSHORT:        code = 'I'; break;
+        case TUSHORT:       code = 'U'; break;
+        case TINT:          code = 'J'; break;
+        case TUINT:         code = 'V'; break;
+        case TLONGLONG:     code = 'K'; break;
+        case TFLOAT:        code = 'E'; break;
+        case TDOUBLE:       code = 'D'; break;
+        case TCOMPLEX:      code = 'C'; break;
+        case TDBLCOMPLEX:   code = 'M'; break;
+        case TSTRING: // one string per row
+            n = col->width;
+            code = 'A';
+        break;
+        default:
+            return FALSE;
+    }
+    snprintf(col->format, FLEN_FORMAT, "%ld%c", n, code);
+    return TRUE;
 }
 
 void tablefree(FITStable **tbl){
@@ -250,14 +429,14 @@ void tablefree(FITStable **tbl){
     size_t i, N = intab->ncols;
     for(i = 0; i < N; ++i){
         table_column *col = &(intab->columns[i]);
-        if(col->coltype == TSTRING && col->width){
+        if(col->coltype == TSTRING && col->contents){
             size_t r, R = col->repeat;
-            void **cont = (void**) col->contents;
-            for(r = 0; r < R; ++r) free(*(cont++));
+            char **cont = (char**) col->contents;
+            for(r = 0; r < R; ++r) free(cont[r]);
         }
         FREE(col->contents);
-        FREE(col);
     }
+    FREE(intab->columns);
     FREE(*tbl);
 }
 
@@ -268,6 +447,7 @@ FITStables *table_copy(FITStables *intab){
     if(!intab || intab->amount == 0) return NULL;
     FITStables *tbl = MALLOC(FITStables, 1);
     size_t N = intab->amount, i;
+    tbl->amount = N;
     tbl->tables = MALLOC(FITStable*, N);
     for(i = 0; i < N; ++i){
         FITStable *cur = MALLOC(FITStable, 1);
@@ -278,80 +458,159 @@ FITStables *table_copy(FITStables *intab){
         memcpy(cur->columns, in->columns, sizeof(table_column)*ncols);
         table_column *ocurcol = cur->columns, *icurcol = in->columns;
         for(col = 0; col < ncols; ++col, ++ocurcol, ++icurcol){
-            if(ocurcol->coltype == TSTRING && ocurcol->width){ // string array - copy all
+            if(ocurcol->coltype == TSTRING){ // string array - copy all
                 size_t r, R = ocurcol->repeat;
-                char **oarr = (char**)ocurcol->contents, **iarr = (char**)icurcol->contents;
-                for(r = 0; r < R; ++r, ++oarr, ++iarr) *oarr = strdup(*iarr);
-            }else memcpy(ocurcol->contents, icurcol->contents, icurcol->repeat * icurcol->width);
+                char **oarr = MALLOC(char*, R), **iarr = (char**)icurcol->contents;
+                ocurcol->contents = oarr;
+                for(r = 0; r < R; ++r) oarr[r] = strdup(iarr[r]);
+            }else{
+                size_t len = icurcol->repeat * COL_NELEM(icurcol) * col_elsize(icurcol->coltype);
+                ocurcol->contents = MALLOC(uint8_t, len);
+                memcpy(ocurcol->contents, icurcol->contents, len);
+            }
         }
         tbl->tables[i] = cur;
     }
     return tbl;
 }
 
+/**
+ * add table 'tab' to list of tables of image 'img'
+ */
+static void table_attach(IMAGE *img, FITStable *tab){
+    if(!img->tables) img->tables = MALLOC(FITStables, 1);
+    size_t N = ++img->tables->amount;
+    if(!(img->tables->tables = realloc(img->tables->tables, sizeof(FITStable*)*N))) ERR("realloc()");
+    img->tables->tables[N-1] = tab;
+}
+
+/**
+ * get maximal length of strings in variable-length column 'colnum'
+ * @return -1 if failed
+ */
+static long vla_maxlen(fitsfile *fp, int colnum, long nrows){
+    long *len = MALLOC(long, nrows), *addr = MALLOC(long, nrows), r, maxlen = 1;
+    FITSFUN(fits_read_descripts, fp, colnum, 1, nrows, len, addr);
+    if(fitsstatus) maxlen = -1;
+    else for(r = 0; r < nrows; ++r) if(len[r] > maxlen) maxlen = len[r];
+    FREE(len); FREE(addr);
+    return maxlen;
+}
+
 /**
  * add FITS table to image structure
+ * All columns are read together by chunks of optimal (for cfitsio buffers) amount of rows
+ * into contiguous arrays of native types, so table_write() can save them without copying.
+ * Variable-length strings are stored as fixed-length, other variable-length arrays are skipped.
  */
 FITStable *table_read(IMAGE *img, fitsfile *fp){
-    int ncols, i;
-    long nrows;
+    int ncols, i, st = 0;
+    long nrows, chunk, row;
     char extname[FLEN_VALUE];
+    FITStable *tbl = NULL;
+    int *colnum = NULL;
+    bool *vla = NULL; // columns of variable-length strings
+#ifdef EBUG
+    double t0 = dtime();
+#endif
     #define TRYRET(f, ...) do{TRYFITS(f, fp, __VA_ARGS__); if(fitsstatus) goto ret;}while(0)
     TRYRET(fits_get_num_rows, &nrows);
     TRYRET(fits_get_num_cols, &ncols);
-    TRYRET(fits_read_key, TSTRING, "EXTNAME", extname, NULL);
-    DBG("Table named %s with %ld rows and %d columns", extname, nrows, ncols);
-    FITStable *tbl = table_new(img, extname);
-    if(!tbl) return NULL;
+    TRYRET(fits_get_rowsize, &chunk);
+    if(fits_read_key(fp, TSTRING, "EXTNAME", extname, NULL, &st))
+        snprintf(extname, FLEN_VALUE, "TABLE");
+    DBG("Table named %s with %ld rows and %d columns, read by %ld rows", extname, nrows, ncols, chunk);
+    if(chunk < 1) chunk = 1;
+    tbl = MALLOC(FITStable, 1);
+    snprintf(tbl->tabname, 80, "%s", extname);
+    tbl->nrows = nrows;
+    tbl->columns = MALLOC(table_column, ncols);
+    colnum = MALLOC(int, ncols);
+    vla = MALLOC(bool, ncols);
     for(i = 1; i <= ncols; ++i){
-        int typecode;
+        int typecode, elsize;
+        bool isvla = FALSE;
         long repeat, width;
-        FITSFUN(fits_get_coltype, fp, i, &typecode, &repeat, &width);
+        FITSFUN(fits_get_eqcoltype, fp, i, &typecode, &repeat, &width);
         if(fitsstatus){
             WARNX(_("Can't read column %d!"), i);
             continue;
         }
+        if(typecode == -TSTRING){ // variable-length strings are read as fixed-length
+            if((repeat = vla_maxlen(fp, i, nrows)) < 0) continue;
+            typecode = TSTRING;
+            isvla = TRUE;
+        }
         DBG("typecode=%d, repeat=%ld, width=%ld", typecode, repeat, width);
-        table_column col = {.repeat = repeat, .width = width, .coltype = typecode};
-        void *array = malloc(width*repeat);
-        if(!array) ERRX("malloc");
-        int anynul;
-        int64_t nullval = 0;
-        int j;
-        for(j = 0; j < repeat; ++j){
-            FITSFUN(fits_read_col, fp, typecode, i, j=1, 1, 1, (void*)nullval, array, &anynul);
+        // cfitsio's TLONG/TULONG are C 'long', but 'J'/'V' columns are 32-bit
+        if(typecode == TLONG) typecode = TINT;
+        else if(typecode == TULONG) typecode = TUINT;
+        if(typecode < 0 || repeat < 1 || !(elsize = col_elsize(typecode))){
+            WARNX(_("Column %d has unsupported type %d, skip it"), i, typecode);
+            continue;
+        }
+        table_column *col = &tbl->columns[tbl->ncols];
+        char keyword[FLEN_KEYWORD];
+        st = 0;
+        fits_make_keyn("TTYPE", i, keyword, &st);
+        if(fits_read_key(fp, TSTRING, keyword, col->colname, NULL, &st)) snprintf(col->colname, FLEN_KEYWORD, "col%d", i);
+        st = 0;
+        fits_make_keyn("TUNIT", i, keyword, &st);
+        if(fits_read_key(fp, TSTRING, keyword, col->unit, NULL, &st)) *col->unit = 0;
+        col->coltype = typecode;
+        col->repeat = nrows;
+        if(typecode == TSTRING){ // one string of 'repeat' characters per row
+            col->width = repeat;
+            col->nelem = 1;
+            char **str = MALLOC(char*, nrows);
+            long r;
+            for(r = 0; r < nrows; ++r) str[r] = MALLOC(char, repeat + 1);
+            col->contents = str;
+        }else{
+            col->width = elsize;
+            col->nelem = repeat;
+            col->contents = MALLOC(uint8_t, (size_t)nrows * repeat * elsize);
+        }
+        col_format(col);
+        vla[tbl->ncols] = isvla;
+        colnum[tbl->ncols++] = i;
+    }
+    fitsstatus = 0; // bad columns are already skipped
+    for(row = 1; row <= nrows; row += chunk){
+        long n = MIN(chunk, nrows - row + 1);
+        for(i = 0; i < tbl->ncols; ++i){
+            table_column *col = &tbl->columns[i];
+            uint8_t *ptr = (uint8_t*)col->contents + (row - 1) * col->nelem * col_elsize(col->coltype);
+            int anynul;
+            if(col->coltype == TBIT){ // bits of each row are padded to whole bytes in file
+                long r;
+                for(r = 0; r < n && !fitsstatus; ++r)
+                    FITSFUN(fits_read_col, fp, TBIT, colnum[i], row + r, 1, col->nelem, NULL,
+                            ptr + r * col->nelem, &anynul);
+            }else if(vla[i]){ // cfitsio gives one variable-length string per call
+                char **str = (char**)ptr;
+                long r;
+                for(r = 0; r < n && !fitsstatus; ++r)
+                    FITSFUN(fits_read_col, fp, TSTRING, colnum[i], row + r, 1, 1, NULL, &str[r], &anynul);
+            }else
+                FITSFUN(fits_read_col, fp, col->coltype, colnum[i], row, 1, n * col->nelem, NULL, ptr, &anynul);
             if(fitsstatus){
-                WARNX(_("Can't read column %d row %d!"), i, j);
-                continue;
+                WARNX(_("Can't read column %s!"), col->colname);
+                goto ret;
             }
         }
-        DBG("done");
-        continue;
-        col.contents = array;
-        char keyword[FLEN_KEYWORD];
-        int stat = 0;
-        fits_make_keyn("TTYPE", i, keyword, &stat);
-        if(stat){WARNX("???"); stat = 0;}
-        fits_read_key(fp, TSTRING, keyword, col.colname, NULL, &stat);
-        if(stat){ sprintf(col.colname, "noname"); stat = 0;}
-        fits_make_keyn("TUNIT", i, keyword, &stat);
-        if(stat){WARNX("???"); stat = 0;}
-        fits_read_key(fp, TSTRING, keyword, col.unit, NULL, &stat);
-        if(stat) *col.unit = 0;
-        DBG("Column, cont[2]=%d, type=%d, w=%ld, r=%ld, nm=%s, u=%s", ((int*)col.contents)[2], col.coltype,
-            col.width, col.repeat, col.colname, col.unit);
-        //table_addcolumn(tbl, &col);
-        FREE(array);
-    }
-//  DBG("fits_create_tbl nrows=%zd, ncols=%zd, colnms[0]=%s, formats[0]=%s, "
-//          "units[0]=%s, name=%s", tbl->nrows, cols, tbl->colnames[0], tbl->formats[0], tbl->units[0], tbl->tabname);
-
+    }
+    DBG("Table %s read, time=%gs", tbl->tabname, dtime() - t0);
     #undef TRYRET
 ret:
-    if(fitsstatus){
+    FREE(colnum);
+    FREE(vla);
+    if(fitsstatus || (tbl && tbl->ncols == 0)){
+        WARNX(_("Can't read table %s"), tbl ? tbl->tabname : "");
         tablefree(&tbl);
-        --img->tables->amount;
+        return NULL;
     }
+    table_attach(img, tbl);
     return tbl;
 }
 
@@ -359,124 +618,111 @@ ret:
  * create empty FITS table for image 'img'
  */
 FITStable *table_new(IMAGE *img, char *tabname){
-    if(!img->tables) img->tables = MALLOC(FITStables, 1);
-    size_t N = ++img->tables->amount;
-    if(!(img->tables->tables = realloc(img->tables->tables, sizeof(FITStable*)*N))) ERR("realloc()");
     FITStable *tab = MALLOC(FITStable, 1);
     snprintf(tab->tabname, 80, "%s", tabname);
     DBG("add new table: %s", tabname);
-    img->tables->tables[N-1] = tab;
+    table_attach(img, tab);
     return tab;
 }
 
 /**
  * add to table 'tbl' column 'column'
  * Be carefull all fields of 'column' exept of 'format' should be filled
- * - if data is character array, 'width' should be equal 0
+ * - 'repeat' is amount of rows, 'nelem' - amount of elements in each row (0 for scalar)
+ * - if data is character array, 'width' should be equal 0 (one character per row),
+ *   else 'contents' is array of 'repeat' strings with length not more than 'width'
  * - all input data will be copied, so caller should run 'free' after this function!
  */
 FITStable *table_addcolumn(FITStable *tbl, table_column *column){
     FNAME();
     if(!tbl || !column || !column->contents) return NULL;
-    long nrows = column->repeat;
-    int width = column->width;
+    long nrows = column->repeat, n;
     if(tbl->nrows < nrows) tbl->nrows = nrows;
-    size_t datalen = nrows * width, cols = ++tbl->ncols;
-    char *curformat = column->format;
-    DBG("add column; width: %d, nrows: %ld, name: %s", width, nrows, column->colname);
-    /*void convchar(){ // count maximum length of strings in array
-        char **charr = (char**)column->contents, *dptr = charr;
-        size_t n, N = column->repeat;
-        for(n = 0; n < N; ++n){
-            if(strlen(
-            if(*dptr++ == 0){ --processed; if(len > maxlen) maxlen = len; len = 0; }
-            else{ ++len; }
+    DBG("add column; width: %ld, nrows: %ld, name: %s", column->width, nrows, column->colname);
+    table_column newcol = *column;
+    if(newcol.coltype == TSTRING){
+        char **optr = MALLOC(char*, nrows);
+        if(newcol.width == 0){ // convert character array into 1-character strings
+            char *iptr = (char*)column->contents;
+            newcol.width = 1;
+            for(n = 0; n < nrows; ++n){
+                optr[n] = MALLOC(char, 2);
+                optr[n][0] = iptr[n];
+            }
+        }else{
+            char **iptr = (char**)column->contents;
+            for(n = 0; n < nrows; ++n) optr[n] = strdup(iptr[n]);
         }
-    }*/
-    #define CHKLEN(type) do{if(width != sizeof(type)) datalen = sizeof(type) * nrows;}while(0)
-    switch(column->coltype){
+        newcol.nelem = 1;
+        newcol.contents = optr;
+    }else{
+        int elsize = col_elsize(newcol.coltype);
+        if(!elsize){
+            WARNX(_("Unsupported column data type!"));
+            return NULL;
+        }
+        size_t datalen = nrows * COL_NELEM(column) * elsize;
+        newcol.width = elsize;
+        newcol.contents = MALLOC(uint8_t, datalen);
+        DBG("copy %zd bytes", datalen);
+        memcpy(newcol.contents, column->contents, datalen);
+    }
+    col_format(&newcol);
+    size_t cols = ++tbl->ncols;
+    if(!(tbl->columns = realloc(tbl->columns, sizeof(table_column)*cols))) ERRX("malloc");
+    tbl->columns[cols-1] = newcol;
+    return tbl;
+}
+
+/**
+ * print element 'idx' of column 'col'
+ */
+static void print_elem(table_column *col, long idx){
+    double *dpair; float *fpair;
+    switch(col->coltype){
         case TBIT:
-            snprintf(curformat, FLEN_FORMAT, "%ldX", nrows);
-            CHKLEN(int8_t);
-        break;
         case TBYTE:
-            snprintf(curformat, FLEN_FORMAT, "%ldB", nrows);
-            CHKLEN(int8_t);
+            printf("%u", ((uint8_t*)col->contents)[idx]);
         break;
         case TLOGICAL:
-            snprintf(curformat, FLEN_FORMAT, "%ldL", nrows);
-            CHKLEN(int8_t);
+            printf("%s", ((int8_t*)col->contents)[idx] == 0 ? "FALSE" : "TRUE");
         break;
         case TSTRING:
-            if(width == 0){
-                snprintf(curformat, FLEN_FORMAT, "%ldA", nrows);
-                datalen = nrows;
-            }else
-                snprintf(curformat, FLEN_FORMAT, "%ldA%d", nrows, width);
+            printf("%s", ((char**)col->contents)[idx]);
         break;
         case TSHORT:
-            snprintf(curformat, FLEN_FORMAT, "%ldI", nrows);
-            CHKLEN(int16_t);
+            printf("%d", ((int16_t*)col->contents)[idx]);
         break;
-        case TLONG:
-            snprintf(curformat, FLEN_FORMAT, "%ldJ", nrows);
-            CHKLEN(int32_t);
+        case TINT:
+            printf("%d", ((int32_t*)col->contents)[idx]);
         break;
         case TLONGLONG:
-            snprintf(curformat, FLEN_FORMAT, "%ldK", nrows);
-            CHKLEN(int64_t);
+            printf("%" PRId64, ((int64_t*)col->contents)[idx]);
         break;
         case TFLOAT:
-            snprintf(curformat, FLEN_FORMAT, "%ldE", nrows);
-            CHKLEN(float);
+            printf("%g", ((float*)col->contents)[idx]);
         break;
         case TDOUBLE:
-            snprintf(curformat, FLEN_FORMAT, "%ldD", nrows);
-            CHKLEN(double);
+            printf("%g", ((double*)col->contents)[idx]);
         break;
         case TCOMPLEX:
-            snprintf(curformat, FLEN_FORMAT, "%ldM", nrows);
-            if(width != sizeof(float)*2) datalen = sizeof(float) * nrows * 2;
+            fpair = (float*)col->contents + 2*idx;
+            printf("%g %s %g*i", fpair[0], fpair[1] < 0 ? "-" : "+", fabsf(fpair[1]));
         break;
         case TDBLCOMPLEX:
-            snprintf(curformat, FLEN_FORMAT, "%ldM", nrows);
-            if(width != sizeof(double)*2) datalen = sizeof(double) * nrows * 2;
-        break;
-        case TINT:
-            snprintf(curformat, FLEN_FORMAT, "%ldJ", nrows);
-            CHKLEN(int32_t);
+            dpair = (double*)col->contents + 2*idx;
+            printf("%g %s %g*i", dpair[0], dpair[1] < 0 ? "-" : "+", fabs(dpair[1]));
         break;
         case TSBYTE:
-            snprintf(curformat, FLEN_FORMAT, "%ldS", nrows);
-            CHKLEN(int8_t);
+            printf("%d", ((int8_t*)col->contents)[idx]);
         break;
         case TUINT:
-            snprintf(curformat, FLEN_FORMAT, "%ldV", nrows);
-            CHKLEN(int32_t);
+            printf("%u", ((uint32_t*)col->contents)[idx]);
         break;
         case TUSHORT:
-            snprintf(curformat, FLEN_FORMAT, "%ldU", nrows);
-            CHKLEN(int16_t);
+            printf("%d", ((uint16_t*)col->contents)[idx]);
         break;
-        default:
-            WARNX(_("Unsupported column data type!"));
-            return NULL;
     }
-
-    DBG("new size: %ld, old: %ld", sizeof(table_column)*cols, sizeof(table_column)*(cols-1));
-    if(!(tbl->columns = realloc(tbl->columns, sizeof(table_column)*cols))) ERRX("malloc");
-    table_column *newcol = &(tbl->columns[cols-1]);
-    memcpy(newcol, column, sizeof(table_column));
-    newcol->contents = calloc(datalen, 1);
-    if(!newcol->contents) ERRX("malloc");
-    DBG("copy %zd bytes", datalen);
-    if(column->coltype == TSTRING && width){
-        long n;
-        char **optr = (char**)newcol->contents, **iptr = (char**)column->contents;
-        for(n = 0; n < nrows; ++n, ++optr, ++iptr) *optr = strdup(*iptr);
-    }else
-        memcpy(newcol->contents, column->contents, datalen);
-    return tbl;
 }
 
 void table_print(FITStable *tbl){
@@ -491,58 +737,17 @@ void table_print(FITStable *tbl){
     printf("\n");
     for(r = 0; r < rows; ++r){
         for(c = 0; c < cols; ++c){
-            double *dpair; float *fpair;
             table_column *col = &(tbl->columns[c]);
-            if(col->repeat < r){ // table with columns of different length
+            if(col->repeat <= r){ // table with columns of different length
                 printf("(empty)\t");
                 continue;
             }
-            switch(col->coltype){
-                case TBIT:
-                case TBYTE:
-                    printf("%u\t", ((uint8_t*)col->contents)[r]);
-                break;
-                case TLOGICAL:
-                    printf("%s\t", ((int8_t*)col->contents)[r] == 0 ? "FALSE" : "TRUE");
-                break;
-                case TSTRING:
-                    if(col->width == 0) printf("%c\t", ((char*)col->contents)[r]);
-                    else printf("%s\t", ((char**)col->contents)[r]);
-                break;
-                case TSHORT:
-                    printf("%d\t", ((int16_t*)col->contents)[r]);
-                break;
-                case TLONG:
-                case TINT:
-                    printf("%d\t", ((int32_t*)col->contents)[r]);
-                break;
-                case TLONGLONG:
-                    printf("%zd\t", ((int64_t*)col->contents)[r]);
-                break;
-                case TFLOAT:
-                    printf("%g\t", ((float*)col->contents)[r]);
-                break;
-                case TDOUBLE:
-                    printf("%g\t", ((double*)col->contents)[r]);
-                break;
-                case TCOMPLEX:
-                    fpair = (float*)col->contents + 2*r;
-                    printf("%g %s %g*i\t", fpair[0], fpair[1] > 0 ? "+" : "-", fpair[1]);
-                break;
-                case TDBLCOMPLEX:
-                    dpair = (double*)col->contents + 2*r;
-                    printf("%g %s %g*i\t", dpair[0], dpair[1] > 0 ? "+" : "-", dpair[1]);
-                break;
-                case TSBYTE:
-                    printf("%d\t", ((int8_t*)col->contents)[r]);
-                break;
-                case TUINT:
-                    printf("%d\t", ((uint32_t*)col->contents)[r]);
-                break;
-                case TUSHORT:
-                    printf("%d\t", ((uint16_t*)col->contents)[r]);
-                break;
+            long e, N = COL_NELEM(col);
+            for(e = 0; e < N; ++e){
+                if(e) printf(" ");
+                print_elem(col, r*N + e);
             }
+            printf("\t");
         }
         printf("\n");
     }
@@ -555,8 +760,32 @@ void table_print_all(IMAGE *img){
         table_print(img->tables->tables[i]);
 }
 
+/**
+ * write rows [row, row+n) of column 'col' into column 'colnum' of current table HDU
+ */
+static void write_colrows(fitsfile *fp, table_column *col, int colnum, long row, long n){
+    long nelem = COL_NELEM(col);
+    if(row + n - 1 > col->repeat) n = col->repeat - row + 1; // table with columns of different length
+    if(n < 1) return;
+    uint8_t *ptr = (uint8_t*)col->contents + (row - 1) * nelem * col_elsize(col->coltype);
+    if(col->coltype == TBIT){ // bits of each row are padded to whole bytes
+        long r;
+        for(r = 0; r < n && !fitsstatus; ++r)
+            TRYFITS(fits_write_col, fp, TBIT, colnum, row + r, 1, nelem, ptr + r*nelem);
+    }else if(G.tabvla && col->coltype == TSTRING){ // variable-length string is written by one row
+        char **str = (char**)ptr;
+        long r;
+        for(r = 0; r < n && !fitsstatus; ++r)
+            TRYFITS(fits_write_col, fp, TSTRING, colnum, row + r, 1, 1, &str[r]);
+    }else
+        TRYFITS(fits_write_col, fp, col->coltype, colnum, row, 1, n * nelem, ptr);
+}
+
 /**
  * save all tables of given image into file
+ * Rows are written by blocks of optimal (for cfitsio buffers) size across all columns,
+ * so wide tables are filled sequentially instead of passing through whole HDU for each column.
+ * With G.tabvla strings are stored as variable-length arrays.
  */
 void table_write(IMAGE *img, fitsfile *fp){
     FNAME();
@@ -574,29 +803,43 @@ void table_write(IMAGE *img, fitsfile *fp){
         char **columns = MALLOC(char*, cols);
         char **formats = MALLOC(char*, cols);
         char **units = MALLOC(char*, cols);
+        char *vlaformats = MALLOC(char, cols * FLEN_VALUE);
         table_column *col = tbl->columns;
         for(c = 0; c < cols; ++c, ++col){
             columns[c] = col->colname;
             formats[c] = col->format;
             units[c] = col->unit;
+            if(G.tabvla && col->coltype == TSTRING){
+                long r, maxlen = 1;
+                char **str = (char**)col->contents;
+                for(r = 0; r < col->repeat; ++r){
+                    long l = strlen(str[r]);
+                    if(l > maxlen) maxlen = l;
+                }
+                formats[c] = vlaformats + c * FLEN_VALUE;
+                snprintf(formats[c], FLEN_VALUE, "1PA(%ld)", maxlen);
+            }
             DBG("col: %s, form: %s, unit: %s", columns[c], formats[c], units[c]);
         }
         FITSFUN(fits_create_tbl, fp, BINARY_TBL, tbl->nrows, cols,
             columns, formats, units, tbl->tabname);
-        FREE(columns); FREE(formats); FREE(units);
+        FREE(columns); FREE(formats); FREE(units); FREE(vlaformats);
         if(fitsstatus){
             WARNX(_("Can't write table %s!"), tbl->tabname);
             continue;
         }
-        col = tbl->columns;
-        for(c = 0; c < cols; ++c, ++col){
-            DBG("write column %zd", c);
-            TRYFITS(fits_write_col, fp, col->coltype, c+1, 1, 1, col->repeat, col->contents);
-            if(fitsstatus){
-                WARNX(_("Can't write column %s!"), col->colname);
-            continue;
-            }
+        long row, chunk = 1;
+        TRYFITS(fits_get_rowsize, fp, &chunk);
+        if(fitsstatus || chunk < 1) chunk = 1;
+        fitsstatus = 0;
+        DBG("write %ld rows by %ld", tbl->nrows, chunk);
+        for(row = 1; row <= tbl->nrows && !fitsstatus; row += chunk){
+            long n = MIN(chunk, tbl->nrows - row + 1);
+            col = tbl->columns;
+            for(c = 0; c < cols && !fitsstatus; ++c, ++col)
+                write_colrows(fp, col, c+1, row, n);
         }
+        if(fitsstatus) WARNX(_("Can't write table %s!"), tbl->tabname);
         /*int hdutype;
         TRYFITS(fits_movabs_hdu, fp, ++img->lasthdu, &hdutype);
         if(fitsstatus){
@@ -607,39 +850,55 @@ void table_write(IMAGE *img, fitsfile *fp){
 }
 
 /**
- * read FITS file and fill 'IMAGE' structure (with headers and tables)
- * can't work with image stack - opens the first image met
- * works only with binary tables
+ * get size & data type of image in current HDU
+ * @param nplanes (o) - amount of planes of data cube (0 for 2-D image) or NULL if cubes aren't allowed
+ * @return FALSE if failed
  */
-IMAGE* readFITS(char *filename, IMAGE **fits){
+static bool read_img_param(fitsfile *fp, IMAGE *img, long *nplanes){
+    int naxis = 0;
+    long naxes[3] = {0, 0, 0};
+    TRYFITS(fits_get_img_param, fp, 3, &img->dtype, &naxis, naxes);
+    if(fitsstatus) return FALSE;
+    // take into account BZERO/BSCALE: e.g. unsigned short or scaled integers
+    TRYFITS(fits_get_img_equivtype, fp, &img->dtype);
+    if(fitsstatus) return FALSE;
+    if(naxis > 3 || (naxis == 3 && !nplanes)){
+        WARNX(_("Images with > 2 dimensions are not supported"));
+        return FALSE;
+    }
+    if(nplanes) *nplanes = (naxis == 3) ? naxes[2] : 0;
+    img->width = naxes[0];
+    img->height = naxes[1];
+    DBG("got image %ldx%ld pix, bitpix=%d", naxes[0], naxes[1], img->dtype);
+    return TRUE;
+}
+
+/**
+ * read headers of all image HDUs & all binary tables of opened file
+ * each non-empty image HDU gives its own 'IMAGE' in chain 'next'; if there's only one
+ * image, headers of all image HDUs are merged, else every image keeps its own header
+ * and header of empty primary HDU is stored in 'primary' of first image
+ * (tables are stored in the first image)
+ * @param fp (i)      - opened FITS file (at return it points to first image HDU)
+ * @param imghdus (o) - allocated array with numbers of image HDUs (for each image of chain)
+ * @param nplanes (o) - amount of planes if first image is data cube or NULL if cubes aren't allowed
+ * @return 'IMAGE' structure without data or NULL if failed
+ */
+static IMAGE *read_headers(fitsfile *fp, int **imghdus, long *nplanes){
     FNAME();
-    #define TRYRET(f, ...) do{TRYFITS(f, __VA_ARGS__); if(fitsstatus) goto returning;}while(0)
-    fitsfile *fp;
-    int i, j, hdunum = 0, hdutype, nkeys, keypos;
-    int naxis;
-    long naxes[2];
+    int i, j, hdunum = 0, hdutype, nkeys, keypos, nimg = 0;
     char card[FLEN_CARD];
-    IMAGE *img = MALLOC(IMAGE, 1);
-    TRYRET(fits_open_file, &fp, filename, READONLY);
+    IMAGE *img = MALLOC(IMAGE, 1), *last = NULL;
+    KeyList *all = NULL, *empty = NULL; // merged headers & header of empty primary HDU
+    int *hdus = NULL;
     FITSFUN(fits_get_num_hdus, fp, &hdunum);
     if(hdunum < 1){
         WARNX(_("Can't read HDU"));
         fitsstatus = 1;
         goto returning;
     }
-    // get image dimensions
-    TRYRET(fits_get_img_param, fp, 2, &img->dtype, &naxis, naxes);
-    if(naxis > 2){
-        WARNX(_("Images with > 2 dimensions are not supported"));
-        fitsstatus = 1;
-        goto returning;
-    }
-    img->width = naxes[0];
-    img->height = naxes[1];
-    DBG("got image %ldx%ld pix, bitpix=%d", naxes[0], naxes[1], img->dtype);
+    hdus = MALLOC(int, hdunum);
     // loop through all HDUs
-    KeyList *list = img->keylist;
-    int imghdu = -1;
     for(i = 1; !(fits_movabs_hdu(fp, i, &hdutype, &fitsstatus)); ++i){
         int hdutype;
         TRYFITS(fits_get_hdu_type, fp, &hdutype);
@@ -651,45 +910,227 @@ IMAGE* readFITS(char *filename, IMAGE **fits){
             table_read(img, fp);
             continue;
         }
-        if(imghdu < 1) imghdu = i;
+        // images are non-empty image HDUs (e.g. compressed image after empty primary)
+        int st = 0, dim = 0, zimg = fits_is_compressed_image(fp, &st);
+        KeyList *list = NULL;
+        fits_get_img_dim(fp, &dim, &st);
         TRYFITS(fits_get_hdrpos, fp, &nkeys, &keypos);
         if(fitsstatus) continue;
         //DBG("HDU # %d of %d keys", i, nkeys);
         for(j = 1; j <= nkeys; ++j){
             FITSFUN(fits_read_record, fp, j, card);
+            if(zimg && fitscomp_key(card)) continue; // binary table & compression keys
             if(!fitsstatus){
-                if(!list_add_record(&list, card)){
+                if(!list_add_record(&list, card) || !list_add_record(&all, card)){
                     /// "     "
                     WARNX(_("Can't add record to list"));
                 }
                 //DBG("key %d: %s", j, card);
             }
         }
+        if(dim > 0){
+            IMAGE *cur = nimg ? MALLOC(IMAGE, 1) : img;
+            if(last) last->next = cur;
+            last = cur;
+            cur->keylist = list;
+            if(!read_img_param(fp, cur, nimg ? NULL : nplanes)){
+                fitsstatus = 1;
+                goto returning;
+            }
+            hdus[nimg++] = i;
+        }else if(i == 1) empty = list;
+        else list_free(&list);
     }
-    img->keylist = list;
     if(fitsstatus == END_OF_FILE){
         fitsstatus = 0;
     }else{
         fits_report_error(stderr, fitsstatus);
         goto returning;
     }
-    if(fits_movabs_hdu(fp, imghdu, &hdutype, &fitsstatus)){
-        WARNX(_("Can't open image HDU #%d"), imghdu);
+    if(nimg < 2){ // single image: merge all headers
+        list_free(&img->keylist);
+        list_free(&empty);
+        img->keylist = all;
+        all = NULL;
+    }else{ // multi-extension file
+        DBG("got %d image extensions", nimg);
+        img->primary = empty;
+        empty = NULL;
+    }
+    if(!nimg) hdus[nimg++] = 1; // there's no image data
+    if(fits_movabs_hdu(fp, hdus[0], &hdutype, &fitsstatus)){
+        WARNX(_("Can't open image HDU #%d"), hdus[0]);
         fitsstatus = 1;
         goto returning;
     }
-    size_t sz = naxes[0] * naxes[1];
-    img->data = MALLOC(double, sz);
-    int stat = 0;
-    TRYFITS(fits_read_img, fp, TDOUBLE, 1, sz, NULL, img->data, &stat);
-    if(stat) WARNX(_("Found %d pixels with undefined value"), stat);
-    DBG("ready");
-    #undef TRYRET
+    if(!last && !read_img_param(fp, img, NULL)) fitsstatus = 1;
 returning:
+    list_free(&all);
+    list_free(&empty);
     if(fitsstatus){
         imfree(&img);
+        FREE(hdus);
+    }
+    *imghdus = hdus;
+    return img;
+}
+
+/**
+ * get data type (BITPIX or USHORT_IMG for "u16") from string
+ * @return 0 if string is wrong
+ */
+int parse_bitpix(char *str){
+    if(!str) return 0;
+    if(strcasecmp(str, "u16") == 0) return USHORT_IMG;
+    char *eptr;
+    long b = strtol(str, &eptr, 10);
+    if(*eptr || eptr == str) return 0;
+    switch(b){
+        case BYTE_IMG:
+        case SHORT_IMG:
+        case LONG_IMG:
+        case LONGLONG_IMG:
+        case FLOAT_IMG:
+        case DOUBLE_IMG:
+            return (int)b;
+        default:
+            return 0;
     }
+}
+
+/**
+ * change data type of image (data would be converted when saving)
+ */
+void set_dtype(IMAGE *img, int dtype){
+    if(img->dtype == dtype) return;
+    image_data(img); // native data can't be kept
+    img->dtype = dtype;
+}
+
+// cfitsio data type of image buffer PIXPTR(img)
+static int img_datatype(IMAGE *img){
+    if(img->pix) return pix_datatype(img->dtype);
+    return TDOUBLE;
+}
+
+/**
+ * read data of image from current HDU
+ * @return FALSE if failed
+ */
+static bool read_data(fitsfile *fp, IMAGE *img){
+    size_t sz = img->width * img->height;
+    int stat = 0;
+    long nnull = 0;
+    // pixels are stored in their native type if it is supported
+    if(pix_datatype(img->dtype)) img->pix = MALLOC(uint8_t, sz * pix_size(img->dtype));
+    else img->data = MALLOC(double, sz);
+    // tile-compressed images are decompressed in parallel, the rest are read by cfitsio
+    if(fitscomp_read(fp, img, &nnull)) stat = (int)nnull;
+    else TRYFITS(fits_read_img, fp, img_datatype(img), 1, sz, NULL, PIXPTR(img), &stat);
+    if(stat) WARNX(_("Found %d pixels with undefined value"), stat);
+    return !fitsstatus;
+}
+
+/**
+ * read pixels of image 'img' from HDU 'src->hdu' of file 'src->filename'
+ */
+static bool load_data(IMAGE *img, lazysrc *src){
+    fitsfile *fp;
+    int hdutype;
+    bool ok;
+    DBG("read data of HDU #%d from %s", src->hdu, src->filename);
+    TRYFITS(fits_open_file, &fp, src->filename, READONLY);
+    if(fitsstatus) return FALSE;
+    TRYFITS(fits_movabs_hdu, fp, src->hdu, &hdutype);
+    ok = !fitsstatus && read_data(fp, img);
     FITSFUN(fits_close_file, fp);
+    return ok;
+}
+
+/**
+ * read pixels of image 'img' if they weren't read yet
+ * (readFITS() reads only headers & tables, data is read at first access)
+ */
+void image_load(IMAGE *img){
+    if(!img || !img->lazy) return;
+    lazysrc *src = img->lazy;
+    bool ok = TRUE;
+    img->lazy = NULL;
+    if(src->map) mmap_pixels(img, src);
+    else if(fits_is_reentrant()) ok = load_data(img, src);
+    else{
+        #pragma omp critical (image_load)
+        ok = load_data(img, src);
+    }
+    if(!ok) ERRX(_("Can't read image data from %s"), src->filename);
+    lazy_free(&src);
+}
+
+/**
+ * free pixels of image keeping its headers & tables
+ */
+void image_drop(IMAGE *img){
+    lazy_free(&img->lazy);
+    free_pix(img);
+    FREE(img->data);
+}
+
+/**
+ * drop data computed from pixels of image (its spectrum): should be called after changing of pixels
+ */
+void image_changed(IMAGE *img){
+    if(!img->spectrum) return;
+    img->spectrum->release(img->spectrum->data);
+    FREE(img->spectrum);
+}
+
+/**
+ * get pointer to image data (native or widened to double), read it if needed
+ */
+void *image_pixels(IMAGE *img){
+    image_load(img);
+    return img->pix ? img->pix : (void*)img->data;
+}
+
+/**
+ * read FITS file and fill 'IMAGE' structure (with headers and tables)
+ * all image extensions of multi-extension file are read into chain 'next'
+ * pixels are read only at first access to them (see image_load())
+ * works only with binary tables
+ */
+IMAGE* readFITS(char *filename, IMAGE **fits){
+    FNAME();
+    fitsfile *fp;
+    int *imghdus = NULL, i, hdutype;
+    IMAGE *img = NULL, *cur;
+    // plain images are read through mmap without cfitsio
+    if((img = mmapFITS(filename))) goto returning;
+    TRYFITS(fits_open_file, &fp, filename, READONLY);
+    if(fitsstatus) goto returning;
+    if((img = read_headers(fp, &imghdus, NULL))){
+        // stdin can't be opened again
+        bool lazy = strcmp(filename, "-") && strncmp(filename, "stdin", 5);
+        for(i = 0, cur = img; cur; cur = cur->next, ++i){
+            if(lazy){
+                cur->lazy = MALLOC(lazysrc, 1);
+                cur->lazy->filename = strdup(filename);
+                cur->lazy->hdu = imghdus[i];
+                continue;
+            }
+            if(i && fits_movabs_hdu(fp, imghdus[i], &hdutype, &fitsstatus)){
+                WARNX(_("Can't open image HDU #%d"), imghdus[i]);
+                fitsstatus = 1;
+            }
+            if(fitsstatus || !read_data(fp, cur)){
+                imfree(&img);
+                break;
+            }
+        }
+        FREE(imghdus);
+        DBG("ready");
+    }
+    FITSFUN(fits_close_file, fp);
+returning:
     if(fits){
         FREE(*fits);
         *fits = img;
@@ -697,40 +1138,408 @@ returning:
     return img;
 }
 
-bool writeFITS(char *filename, IMAGE *fits){
-    if(!filename || !fits) return FALSE;
-    int w = fits->width, h = fits->height;
-    long naxes[2] = {w, h};
-    size_t sz = w * h;
+/**
+ * check whether record 'rec' is obligatory key (it's written by cfitsio itself)
+ */
+static bool obligatory_key(const char *rec){
+    if(strncmp(rec, "SIMPLE", 6) == 0 || strncmp(rec, "EXTEND", 6) == 0) // key "file does conform ..."
+        return TRUE;
+        // comment of obligatory key in FITS head
+    else if(strncmp(rec, "COMMENT   FITS", 14) == 0 || strncmp(rec, "COMMENT   and Astrophysics", 26) == 0)
+        return TRUE;
+    else if(strncmp(rec, "NAXIS", 5) == 0 || strncmp(rec, "BITPIX", 6) == 0) // NAXIS, NAXISxxx, BITPIX
+        return TRUE;
+    else if(strncmp(rec, "XTENSION", 8) == 0 || strncmp(rec, "PCOUNT", 6) == 0
+            || strncmp(rec, "GCOUNT", 6) == 0) // keys of extension
+        return TRUE;
+    else if(strncmp(rec, "BZERO", 5) == 0 || strncmp(rec, "BSCALE", 6) == 0) // scaling is defined by 'dtype'
+        return TRUE;
+    return FALSE;
+}
+
+// output file "-" is created in memory & written into stdout at closing
+static struct{
+    fitsfile *fp;       // file in memory
+    void *buf;          // its buffer (reallocated by cfitsio)
+    size_t size;        // size of buffer
+    int fd;             // descriptor of real stdout
+} memout = {.fd = -1};
+
+/**
+ * redirect stdout to stderr keeping descriptor of real stdout for output file "-",
+ * so messages wouldn't be mixed with FITS data; should be called before any output
+ */
+void stdout_reserve(){
+    if(memout.fd > -1) return;
+    fflush(stdout);
+    if((memout.fd = dup(STDOUT_FILENO)) < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+        ERR(_("Can't redirect stdout"));
+}
+
+/**
+ * create output file 'filename' ("-" for stdout)
+ * @return FALSE if failed
+ */
+static bool create_file(fitsfile **fp, char *filename){
+    if(strcmp(filename, "-")){
+        TRYFITS(fits_create_file, fp, filename);
+        return !fitsstatus;
+    }
+    if(memout.fp){
+        WARNX(_("Only one file could be written into stdout"));
+        return FALSE;
+    }
+    stdout_reserve();
+    memout.size = MEMOUT_CHUNK;
+    memout.buf = MALLOC(uint8_t, memout.size);
+    TRYFITS(fits_create_memfile, fp, &memout.buf, &memout.size, MEMOUT_CHUNK, realloc);
+    if(fitsstatus){
+        FREE(memout.buf);
+        return FALSE;
+    }
+    memout.fp = *fp;
+    return TRUE;
+}
+
+/**
+ * close output file (file in memory is written into stdout if 'ok' is TRUE)
+ * @return FALSE if failed
+ */
+static bool close_file(fitsfile *fp, bool ok){
+    if(fp != memout.fp){
+        FITSFUN(fits_close_file, fp);
+        return ok && !fitsstatus;
+    }
+    LONGLONG hstart, dstart, dend = 0;
+    int nhdus = 0, hdutype;
+    if(ok){ // size of file is the end of last HDU
+        TRYFITS(fits_get_num_hdus, fp, &nhdus);
+        if(!fitsstatus) TRYFITS(fits_movabs_hdu, fp, nhdus, &hdutype);
+        if(!fitsstatus) TRYFITS(fits_get_hduaddrll, fp, &hstart, &dstart, &dend);
+        ok = !fitsstatus;
+    }
+    FITSFUN(fits_close_file, fp);
+    ok = ok && !fitsstatus;
+    if(ok){
+        size_t len = (size_t)(dend + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK, pos = 0;
+        DBG("write %zd bytes into stdout", len);
+        if(len > memout.size) len = memout.size;
+        while(pos < len){
+            ssize_t w = write(memout.fd, (uint8_t*)memout.buf + pos, len - pos);
+            if(w < 0){
+                if(errno == EINTR) continue;
+                WARN(_("Can't write into stdout"));
+                ok = FALSE;
+                break;
+            }
+            pos += w;
+        }
+    }
+    FREE(memout.buf);
+    memout.fp = NULL;
+    return ok;
+}
+
+/**
+ * write all records of header 'records' except of obligatory keys
+ */
+static void write_keylist(fitsfile *fp, KeyList *records){
+    int i = 0;
+    char *rec;
+    while((rec = list_next(records, &i))){
+        if(obligatory_key(rec)) continue;
+        FITSFUN(fits_write_record, fp, rec);
+    //  DBG("write key: %s", rec);
+    }
+}
+
+/**
+ * edit header of current HDU in place
+ * records of edited header should be records of original one in the same order
+ * (some of them could be removed) with new records at the end
+ * @return FALSE if failed
+ */
+static bool edit_hdu(fitsfile *fp, void (*edit)(KeyList **)){
+    int nkeys = 0, i, j = 0, k = 0, nrem = 0;
+    char card[FLEN_CARD], *orec, *erec;
+    KeyList *orig = NULL, *edited;
+    TRYFITS(fits_get_hdrspace, fp, &nkeys, NULL);
+    for(i = 1; i <= nkeys && !fitsstatus; ++i){
+        TRYFITS(fits_read_record, fp, i, card);
+        list_add_record(&orig, card);
+    }
+    if(fitsstatus || !orig){
+        list_free(&orig);
+        return FALSE;
+    }
+    edited = list_copy(orig);
+    edit(&edited);
+    int *removed = MALLOC(int, nkeys);
+    erec = list_next(edited, &j);
+    for(i = 1; i <= nkeys; ++i){
+        orec = list_next(orig, &k);
+        if(erec && strcmp(orec, erec) == 0) erec = list_next(edited, &j);
+        else if(!obligatory_key(orec)) removed[nrem++] = i;
+    }
+    bool chksum = (list_find_key(orig, "CHECKSUM") != NULL);
+    // remove from the end to keep numbers of rest records
+    for(i = nrem - 1; i > -1 && !fitsstatus; --i)
+        TRYFITS(fits_delete_record, fp, removed[i]);
+    for(; erec && !fitsstatus; erec = list_next(edited, &j))
+        TRYFITS(fits_write_record, fp, erec);
+    DBG("removed %d records", nrem);
+    // data isn't changed, so DATASUM is still right
+    if(chksum && !fitsstatus) TRYFITS(fits_update_chksum, fp);
+    FREE(removed);
+    list_free(&orig);
+    list_free(&edited);
+    return !fitsstatus;
+}
+
+/**
+ * edit headers of images of file 'filename' in place without rewriting of data
+ * cfitsio changes header blocks in place while new header fits into them and
+ * shifts data only if header needs more 2880-byte blocks
+ * @param edit - function to change header (only removing & adding of records is allowed)
+ * @return FALSE if file can't be changed this way (e.g. there's tile-compressed images)
+ */
+bool update_header(char *filename, void (*edit)(KeyList **)){
+    FNAME();
     fitsfile *fp;
-    TRYFITS(fits_create_file, &fp, filename);
-    if(fitsstatus) return FALSE;
-    // TODO: save FITS files in original (or given by user) data format!
-    TRYFITS(fits_create_img, fp, fits->dtype, 2, naxes);
+    int i, hdunum = 0, hdutype, nimg = 0, st = 0;
+    bool ret = FALSE;
+    TRYFITS(fits_open_file, &fp, filename, READWRITE);
     if(fitsstatus) return FALSE;
-    if(fits->keylist){ // there's keys
-        KeyList *records = fits->keylist;
-        while(records){
-            char *rec = records->record;
-            records = records->next;
-            if(strncmp(rec, "SIMPLE", 6) == 0 || strncmp(rec, "EXTEND", 6) == 0) // key "file does conform ..."
-                continue;
-                // comment of obligatory key in FITS head
-            else if(strncmp(rec, "COMMENT   FITS", 14) == 0 || strncmp(rec, "COMMENT   and Astrophysics", 26) == 0)
-                continue;
-            else if(strncmp(rec, "NAXIS", 5) == 0 || strncmp(rec, "BITPIX", 6) == 0) // NAXIS, NAXISxxx, BITPIX
-                continue;
-            FITSFUN(fits_write_record, fp, rec);
-        //  DBG("write key: %s", rec);
-        }
+    TRYFITS(fits_get_num_hdus, fp, &hdunum);
+    for(i = 1; i <= hdunum && !fitsstatus; ++i){ // compressed images are rewritten completely
+        TRYFITS(fits_movabs_hdu, fp, i, &hdutype);
+        if(!fitsstatus && fits_is_compressed_image(fp, &st)) goto closefile;
+    }
+    // headers of all non-empty images are edited (or primary header if there's no images)
+    for(i = 1; i <= hdunum && !fitsstatus; ++i){
+        int naxis = 0;
+        TRYFITS(fits_movabs_hdu, fp, i, &hdutype);
+        if(fitsstatus || hdutype != IMAGE_HDU) continue;
+        TRYFITS(fits_get_img_dim, fp, &naxis);
+        if(fitsstatus || naxis == 0) continue;
+        if(!edit_hdu(fp, edit)) goto closefile;
+        ++nimg;
+    }
+    if(!nimg){
+        TRYFITS(fits_movabs_hdu, fp, 1, &hdutype);
+        if(fitsstatus || !edit_hdu(fp, edit)) goto closefile;
+    }
+    ret = !fitsstatus;
+closefile:
+    if(!ret) WARNX(_("Can't edit header of %s in place"), filename);
+    FITSFUN(fits_close_file, fp);
+    return ret && !fitsstatus;
+}
+
+// scaling of floating point data stored as integers: physical = bzero + bscale * stored
+typedef struct{
+    double bscale, bzero;
+    long blank;         // stored value for NaNs
+    bool hasnull;       // TRUE if there's NaNs in data
+} quantpars;
+
+/**
+ * check if floating point data should be quantized to store them as type 'bitpix'
+ * (USHORT_IMG is stored as SHORT_IMG with BZERO selected by data range)
+ */
+static bool quantized_type(int bitpix){
+    return (bitpix == BYTE_IMG || bitpix == SHORT_IMG || bitpix == USHORT_IMG || bitpix == LONG_IMG);
+}
+
+// range of stored values of integer type 'bitpix' (BYTE_IMG, SHORT_IMG or LONG_IMG)
+static void quant_limits(int bitpix, Item *tmin, Item *tmax){
+    switch(bitpix){
+        case BYTE_IMG:  *tmin = 0.;        *tmax = UINT8_MAX; break;
+        case SHORT_IMG: *tmin = INT16_MIN; *tmax = INT16_MAX; break;
+        default:        *tmin = INT32_MIN; *tmax = INT32_MAX;
+    }
+}
+
+/**
+ * expand data range [dmin, dmax] by 'sz' values of 'data'
+ * @param integral (io) - would be FALSE if there's non-integer values
+ * @param nans (io)     - amount of NaNs
+ */
+static void quant_range(Item *data, size_t sz, Item *dmin, Item *dmax, bool *integral, size_t *nans){
+    Item mn = *dmin, mx = *dmax;
+    bool integ = *integral;
+    size_t nn = 0;
+    OMP_FOR(reduction(min:mn) reduction(max:mx) reduction(&&:integ) reduction(+:nn))
+    for(size_t i = 0; i < sz; ++i){
+        Item v = data[i];
+        if(isnan(v)){ ++nn; continue; }
+        if(v < mn) mn = v;
+        if(v > mx) mx = v;
+        if(integ && v != floor(v)) integ = FALSE;
+    }
+    *dmin = mn; *dmax = mx; *integral = integ; *nans += nn;
+}
+
+/**
+ * select scaling parameters to store data range [dmin, dmax] as integer type 'bitpix'
+ * integer data which fits into type range are stored without losses
+ */
+static void quant_scale(int bitpix, Item dmin, Item dmax, bool integral, bool hasnull, quantpars *q){
+    Item tmin, tmax;
+    quant_limits(bitpix, &tmin, &tmax);
+    if(dmin > dmax) dmin = dmax = 0.; // all pixels are NaN
+    q->hasnull = hasnull;
+    q->blank = (long)tmin;
+    if(hasnull) tmin += 1.; // the lowest value is reserved for NaNs
+    double scale = 1., zero = 0.;
+    if(integral && dmax - dmin <= tmax - tmin){
+        if(dmin < tmin || dmax > tmax) zero = dmin - tmin; // e.g. unsigned short into SHORT_IMG
+    }else{
+        if(dmax > dmin) scale = (dmax - dmin) / (tmax - tmin);
+        zero = dmin - tmin * scale;
+    }
+    DBG("quantize [%g, %g] to [%g, %g]: BSCALE=%g, BZERO=%g", dmin, dmax, tmin, tmax, scale, zero);
+    q->bscale = scale; q->bzero = zero;
+}
+
+/**
+ * convert 'sz' floating point values to stored values of integer type 'bitpix'
+ * @return allocated array with stored values
+ */
+static void *quant_data(Item *data, size_t sz, int bitpix, quantpars *q){
+    Item tmin, tmax, scale = q->bscale, zero = q->bzero;
+    long blank = q->blank;
+    quant_limits(bitpix, &tmin, &tmax);
+    if(q->hasnull) tmin += 1.;
+    void *buf = MALLOC(uint8_t, sz * pix_size(bitpix));
+    #define QUANT(type) do{ type *q = (type*)buf;                          \
+        OMP_FOR()                                                           \
+        for(size_t i = 0; i < sz; ++i){                                     \
+            Item v = data[i];                                               \
+            if(isnan(v)){ q[i] = (type)blank; continue; }                   \
+            v = round((v - zero) / scale);                                  \
+            if(v < tmin) v = tmin; else if(v > tmax) v = tmax;              \
+            q[i] = (type)v;                                                 \
+        }}while(0)
+    switch(bitpix){
+        case BYTE_IMG:  QUANT(uint8_t); break;
+        case SHORT_IMG: QUANT(int16_t); break;
+        default:        QUANT(int32_t);
     }
+    #undef QUANT
+    return buf;
+}
+
+/**
+ * quantize floating point data of image 'img' to integer type 'bitpix'
+ * (BYTE_IMG, SHORT_IMG or LONG_IMG)
+ * @param q (o) - scaling parameters
+ * @return allocated array with stored values
+ */
+static void *quantize(IMAGE *img, int bitpix, quantpars *q){
+    size_t sz = img->width * img->height, nans = 0;
+    Item dmin = DBL_MAX, dmax = -DBL_MAX;
+    bool integral = TRUE;
+    quant_range(img->data, sz, &dmin, &dmax, &integral, &nans);
+    quant_scale(bitpix, dmin, dmax, integral, nans > 0, q);
+    return quant_data(img->data, sz, bitpix, q);
+}
+
+/**
+ * write scaling keys of quantized data into current HDU & turn off scaling to write stored values
+ * @param zc - compression type (ZCMP_NONE for ordinary image)
+ * @return FALSE if failed
+ */
+static bool write_quantpars(fitsfile *fp, quantpars *q, int zc){
+    TRYFITS(fits_update_key, fp, TDOUBLE, "BSCALE", &q->bscale, "physical = BZERO + BSCALE * stored");
+    TRYFITS(fits_update_key, fp, TDOUBLE, "BZERO", &q->bzero, NULL);
+    if(q->hasnull) TRYFITS(fits_update_key, fp, TLONG, zc ? "ZBLANK" : "BLANK", &q->blank,
+                           "value of undefined pixels");
+    if(!zc){ // compressed tiles are written as is
+        TRYFITS(fits_set_hdustruc, fp);
+        TRYFITS(fits_set_bscale, fp, 1., 0.);
+    }
+    return !fitsstatus;
+}
+
+/**
+ * write image 'fits' into new HDU of opened file
+ * native data are stored as is, double data are stored in type 'dtype'
+ * (for integer types with BSCALE/BZERO quantization)
+ * @param zc (io) - compression parameters
+ * @return FALSE if failed
+ */
+static bool write_image(fitsfile *fp, IMAGE *fits, FITScompress *zc){
+    image_load(fits);
+    int w = fits->width, h = fits->height, bitpix = fits->dtype, datatype = img_datatype(fits);
+    long naxes[2] = {w, h};
+    size_t sz = w * h;
+    quantpars q;
+    void *buf = PIXPTR(fits), *qbuf = NULL;
+    if(!fits->pix && quantized_type(bitpix)){
+        if(bitpix == USHORT_IMG) bitpix = SHORT_IMG; // BZERO would be selected by data range
+        buf = qbuf = quantize(fits, bitpix, &q);
+        datatype = pix_datatype(bitpix);
+    }
+    if(zc->type != ZCMP_NONE && !fitscomp_supported(bitpix, datatype)){
+        WARNX(_("Images with BITPIX=%d can't be compressed, save them as is"), bitpix);
+        zc->type = ZCMP_NONE;
+    }
+    if(zc->type != ZCMP_NONE){ // compressed image in binary table after empty primary HDU
+        int nhdus = 0;
+        FITSFUN(fits_get_num_hdus, fp, &nhdus);
+        if(!nhdus) TRYFITS(fits_create_img, fp, BYTE_IMG, 0, NULL);
+        if(fitsstatus || !fitscomp_create(fp, bitpix, w, h, zc)) goto rtnfalse;
+    }else{
+        TRYFITS(fits_create_img, fp, bitpix, 2, naxes);
+        if(fitsstatus) goto rtnfalse;
+    }
+    if(fits->keylist) write_keylist(fp, fits->keylist);
+    if(!fits->pix){ // BLANK of original integer data has no sense now
+        int st = 0;
+        fits_delete_key(fp, "BLANK", &st);
+    }
+    if(qbuf && !write_quantpars(fp, &q, zc->type)) goto rtnfalse;
     //fits->lasthdu = 1;
     //FITSFUN(fits_write_record, fp, "COMMENT  modified by simple test routine");
-    TRYFITS(fits_write_img, fp, TDOUBLE, 1, sz, fits->data);
-    if(fitsstatus) return FALSE;
+    if(zc->type){
+        if(!fitscomp_write(fp, buf, datatype, bitpix, w, h, zc)) goto rtnfalse;
+    }else
+        TRYFITS(fits_write_img, fp, datatype, 1, sz, buf);
+    FREE(qbuf);
+    return !fitsstatus;
+rtnfalse:
+    FREE(qbuf);
+    return FALSE;
+}
+
+/**
+ * write image into file 'filename'
+ * images of multi-extension file (chain 'next') are written as extensions
+ * after empty primary HDU with header 'primary' (if any)
+ */
+bool writeFITS(char *filename, IMAGE *fits){
+    if(!filename || !fits) return FALSE;
+    fitsfile *fp;
+    FITScompress zc;
+    if(!fitscomp_parse(&zc)) return FALSE;
+    // output file could replace input one, so all data should be read before
+    for(IMAGE *cur = fits; cur; cur = cur->next) image_load(cur);
+    if(!create_file(&fp, filename)) return FALSE;
+    if(fits->primary){
+        TRYFITS(fits_create_img, fp, BYTE_IMG, 0, NULL);
+        if(fitsstatus) goto rtnfalse;
+        write_keylist(fp, fits->primary);
+    }
+    for(IMAGE *cur = fits; cur; cur = cur->next){
+        FITScompress c = zc; // tile size is corrected for each image
+        if(!write_image(fp, cur, &c)) goto rtnfalse;
+    }
     if(fits->tables && !G.deltabs) table_write(fits, fp);
-    TRYFITS(fits_close_file, fp);
-    return TRUE;
+    return close_file(fp, TRUE);
+rtnfalse:
+    close_file(fp, FALSE);
+    return FALSE;
 }
 
 /**
@@ -746,57 +1555,96 @@ IMAGE *newFITS(size_t h, size_t w, int dtype){
     return out;
 }
 
+/**
+ * cfitsio data type code of native pixel type 'dtype'
+ * @return 0 for types which are widened to double
+ */
+int pix_datatype(int dtype){
+    switch(dtype){
+        case BYTE_IMG:   return TBYTE;
+        case SHORT_IMG:  return TSHORT;
+        case USHORT_IMG: return TUSHORT;
+        case LONG_IMG:   return TINT;
+        case FLOAT_IMG:  return TFLOAT;
+        default:         return 0;
+    }
+}
+
+/**
+ * size of native pixel of type 'dtype' (sizeof(Item) for types widened to double)
+ */
+size_t pix_size(int dtype){
+    switch(dtype){
+        case BYTE_IMG:   return sizeof(uint8_t);
+        case SHORT_IMG:
+        case USHORT_IMG: return sizeof(int16_t);
+        case LONG_IMG:   return sizeof(int32_t);
+        case FLOAT_IMG:  return sizeof(float);
+        default:         return sizeof(Item);
+    }
+}
+
+/**
+ * create an empty image without headers with data buffer of native type 'dtype'
+ * (if this type is not supported, data would be double)
+ */
+IMAGE *nativeFITS(size_t h, size_t w, int dtype){
+    if(!pix_datatype(dtype)) return newFITS(h, w, dtype);
+    IMAGE *out = MALLOC(IMAGE, 1);
+    out->pix = MALLOC(uint8_t, w*h*pix_size(dtype));
+    out->width = w;
+    out->height = h;
+    out->dtype = dtype;
+    return out;
+}
+
+/**
+ * get image data as double array (native data would be widened & freed)
+ * 'dtype' of image stays the same
+ */
+Item *image_data(IMAGE *img){
+    image_load(img);
+    if(img->data || !img->pix) return img->data;
+    size_t sz = img->width * img->height;
+    Item *data = MALLOC(Item, sz);
+    #define WIDEN(type, sfx) do{type *in = (type*)img->pix;             OMP_FOR() for(size_t i = 0; i < sz; ++i) data[i] = (Item)in[i];}while(0)
+    switch(img->dtype){
+        PIX_CASES(WIDEN)
+        default: break;
+    }
+    #undef WIDEN
+    free_pix(img);
+    img->data = data;
+    return data;
+}
+
 /**
  * build IMAGE image from data array indata
  */
 IMAGE *buildFITSfromdat(size_t h, size_t w, int dtype, uint8_t *indata){
-    size_t stride = 0;
-    double (*fconv)(uint8_t *data) = NULL;
-    double ubyteconv(uint8_t *data){return (double)*data;}
-    double ushortconv(uint8_t *data){return (double)*(int16_t*)data;}
-    double ulongconv(uint8_t *data){return (double)*(uint32_t*)data;}
-    double ulonglongconv(uint8_t *data){return (double)*(uint64_t*)data;}
-    double floatconv(uint8_t *data){return (double)*(float*)data;}
-    IMAGE *out = newFITS(h, w, dtype);
+    size_t sz = w*h;
+    IMAGE *out = nativeFITS(h, w, dtype);
+    if(out->pix){ // native type - just copy
+        memcpy(out->pix, indata, sz * pix_size(dtype));
+        return out;
+    }
     switch (dtype){
-        case BYTE_IMG:
-            stride = 1;
-            fconv = ubyteconv;
-        break;
-        case SHORT_IMG:
-            stride = 2;
-            fconv = ushortconv;
-        break;
-        case LONG_IMG:
-            stride = 4;
-            fconv = ulongconv;
-        break;
-        case FLOAT_IMG:
-            stride = 4;
-            fconv = floatconv;
-        break;
-        case LONGLONG_IMG:
-            fconv = ulonglongconv;
-            stride = 8;
+        case LONGLONG_IMG:{
+            Item *data = out->data;
+            int64_t *in = (int64_t*)indata;
+            OMP_FOR()
+            for(size_t i = 0; i < sz; ++i) data[i] = (Item)in[i];
+            return out;
+        }
         break;
         case DOUBLE_IMG:
-            memcpy(out->data, indata, sizeof(double)*w*h);
+            memcpy(out->data, indata, sizeof(double)*sz);
             return out;
         break;
         default:
         ///   
             ERRX(_("Wrong data type"));
     }
-    size_t y, W = w*stride;
-    Item *data = out->data;
-    OMP_FOR(shared(data))
-    for(y = 0; y < h; ++y){
-        Item *dout = &data[y*w];
-        uint8_t *din = &indata[y*W];
-        size_t x;
-        for(x = 0; x < w; ++x, din += stride)
-            *dout++ = fconv(din);
-    }
     return out;
 }
 
@@ -817,13 +1665,292 @@ IMAGE *similarFITS(IMAGE *img, int dtype){
  * make full copy of image 'in'
  */
 IMAGE *copyFITS(IMAGE *in){
-    IMAGE *out = similarFITS(in, in->dtype);
-    memcpy(out->data, in->data, sizeof(Item)*in->width*in->height);
+    IMAGE *out;
+    size_t sz = in->width*in->height;
+    image_load(in);
+    if(in->pix){
+        out = nativeFITS(in->height, in->width, in->dtype);
+        memcpy(out->pix, in->pix, sz*pix_size(in->dtype));
+    }else{
+        out = similarFITS(in, in->dtype);
+        memcpy(out->data, in->data, sizeof(Item)*sz);
+    }
     out->keylist = list_copy(in->keylist);
     out->tables = table_copy(in->tables);
     return out;
 }
 
+/*
+ * Reading/writing image by strips of rows
+ */
+/**
+ * open image for reading by strips
+ * @param filename - input file name
+ * @param striph   - height of strip (without halo)
+ * @param halo     - amount of additional rows above and below each strip
+ * @return stream structure (with headers & tables of file) or NULL if failed
+ */
+FITSstream *stream_open(char *filename, int striph, int halo){
+    FNAME();
+    fitsfile *fp;
+    int *imghdus = NULL;
+    if(striph < 1 || halo < 0) return NULL;
+    TRYFITS(fits_open_file, &fp, filename, READONLY);
+    if(fitsstatus) return NULL;
+    IMAGE *hdr = read_headers(fp, &imghdus, NULL);
+    FREE(imghdus);
+    if(!hdr){
+        FITSFUN(fits_close_file, fp);
+        return NULL;
+    }
+    FITSstream *s = MALLOC(FITSstream, 1);
+    s->fp = fp;
+    s->hdr = hdr;
+    s->striph = striph;
+    s->halo = halo;
+    DBG("open %s (%dx%d) for reading by %d rows (halo: %d)", filename,
+        hdr->width, hdr->height, striph, halo);
+    return s;
+}
+
+/**
+ * open data cube for reading by planes
+ * @param filename - input file name
+ * @return stream structure (with headers & tables of file) or NULL if file isn't a cube
+ */
+FITSstream *cube_open(char *filename){
+    FNAME();
+    fitsfile *fp;
+    int *imghdus = NULL, st = 0, naxis = 0;
+    long nplanes = 0;
+    // check dimension of first non-empty image (errors would be reported by reader)
+    if(fits_open_image(&fp, filename, READONLY, &st)) return NULL;
+    if(fits_get_img_dim(fp, &naxis, &st) || naxis != 3){
+        st = 0;
+        fits_close_file(fp, &st);
+        return NULL;
+    }
+    IMAGE *hdr = read_headers(fp, &imghdus, &nplanes);
+    FREE(imghdus);
+    if(!hdr || nplanes < 1 || hdr->next){
+        if(hdr) imfree(&hdr);
+        FITSFUN(fits_close_file, fp);
+        return NULL;
+    }
+    FITSstream *s = MALLOC(FITSstream, 1);
+    s->fp = fp;
+    s->hdr = hdr;
+    s->nplanes = nplanes;
+    DBG("open %s (%dx%dx%ld) for reading by planes", filename, hdr->width, hdr->height, nplanes);
+    return s;
+}
+
+/**
+ * read next plane of data cube
+ * @return image with plane data or NULL if there's no more planes
+ */
+IMAGE *cube_read_plane(FITSstream *s){
+    if(!s || s->plane >= s->nplanes) return NULL;
+    int stat = 0;
+    IMAGE *plane = nativeFITS(s->hdr->height, s->hdr->width, s->hdr->dtype);
+    long fpix[3] = {1, 1, s->plane + 1};
+    TRYFITS(fits_read_pix, s->fp, img_datatype(plane), fpix,
+        (LONGLONG)plane->width * plane->height, NULL, PIXPTR(plane), &stat);
+    if(fitsstatus){
+        imfree(&plane);
+        return NULL;
+    }
+    if(stat) WARNX(_("Found %d pixels with undefined value"), stat);
+    ++s->plane;
+    return plane;
+}
+
+/**
+ * start reading of stream from first row
+ */
+void stream_rewind(FITSstream *s){
+    if(s) s->y0 = 0;
+}
+
+/**
+ * read next strip of image with halo
+ * at image top & bottom halo is truncated
+ * @param s (io)    - opened stream
+ * @param top (o)   - amount of halo rows above strip (index of strip's first row in returned image)
+ * @param nrows (o) - amount of strip rows (without halo)
+ * @return image with strip + halo or NULL if there's no more rows
+ */
+IMAGE *stream_read_strip(FITSstream *s, int *top, int *nrows){
+    if(!s || s->y0 >= s->hdr->height) return NULL;
+    int w = s->hdr->width, h = s->hdr->height;
+    int y0 = s->y0, y1 = MIN(y0 + s->striph, h); // strip rows: [y0, y1)
+    int ystart = MAX(y0 - s->halo, 0), yend = MIN(y1 + s->halo, h);
+    IMAGE *strip = nativeFITS(yend - ystart, w, s->hdr->dtype);
+    long fpix[2] = {1, ystart + 1};
+    int stat = 0;
+    TRYFITS(fits_read_pix, s->fp, img_datatype(strip), fpix, (LONGLONG)w * (yend - ystart), NULL,
+        PIXPTR(strip), &stat);
+    if(fitsstatus){
+        imfree(&strip);
+        return NULL;
+    }
+    if(stat) WARNX(_("Found %d pixels with undefined value"), stat);
+    if(top) *top = y0 - ystart;
+    if(nrows) *nrows = y1 - y0;
+    s->y0 = y1;
+    return strip;
+}
+
+/**
+ * create new file for writing by strips
+ * @param filename - output file name
+ * @param hdr      - image size, type, headers & tables; stream became its owner
+ * @return stream structure or NULL if failed
+ */
+FITSstream *stream_create(char *filename, IMAGE *hdr){
+    return cube_create(filename, hdr, 0);
+}
+
+/**
+ * create new file for writing of data cube by planes
+ * @param filename - output file name
+ * @param hdr      - plane size, type, headers & tables; stream became its owner
+ * @param nplanes  - amount of planes (0 for 2-D image written by strips)
+ * @return stream structure or NULL if failed
+ */
+FITSstream *cube_create(char *filename, IMAGE *hdr, long nplanes){
+    FNAME();
+    if(!filename || !hdr) return NULL;
+    fitsfile *fp;
+    long naxes[3] = {hdr->width, hdr->height, nplanes};
+    if(!create_file(&fp, filename)) return NULL;
+    TRYFITS(fits_create_img, fp, hdr->dtype, nplanes ? 3 : 2, naxes);
+    if(fitsstatus){
+        close_file(fp, FALSE);
+        return NULL;
+    }
+    if(hdr->keylist) write_keylist(fp, hdr->keylist);
+    FITSstream *s = MALLOC(FITSstream, 1);
+    s->fp = fp;
+    s->hdr = hdr;
+    s->writing = TRUE;
+    s->nplanes = nplanes;
+    return s;
+}
+
+/**
+ * write next plane of data cube
+ * @param s     - stream opened by cube_create
+ * @param plane - image with plane data
+ * @return FALSE if failed
+ */
+bool cube_write_plane(FITSstream *s, IMAGE *plane){
+    if(!s || !plane || s->plane >= s->nplanes || plane->width != s->hdr->width
+        || plane->height != s->hdr->height) return FALSE;
+    size_t sz = plane->width * plane->height;
+    // floating point planes of integer cube need common BSCALE/BZERO, which is known only
+    // after the last plane: spool them into temporary file till stream_close()
+    if(s->plane == 0 && !plane->pix && quantized_type(s->hdr->dtype)){
+        if(!(s->spool = tmpfile())){
+            WARN(_("Can't create temporary file"));
+            return FALSE;
+        }
+        s->qmin = DBL_MAX; s->qmax = -DBL_MAX;
+        s->qintegral = TRUE; s->qnans = 0;
+    }
+    if(s->spool){
+        Item *data = image_data(plane);
+        quant_range(data, sz, &s->qmin, &s->qmax, &s->qintegral, &s->qnans);
+        if(fwrite(data, sizeof(Item), sz, s->spool) != sz){
+            WARN(_("Can't write temporary file"));
+            return FALSE;
+        }
+        ++s->plane;
+        return TRUE;
+    }
+    long fpix[3] = {1, 1, s->plane + 1};
+    TRYFITS(fits_write_pix, s->fp, img_datatype(plane), fpix, (LONGLONG)sz, PIXPTR(plane));
+    if(fitsstatus) return FALSE;
+    ++s->plane;
+    return TRUE;
+}
+
+/**
+ * quantize planes spooled by cube_write_plane() with common BSCALE/BZERO & write them
+ * @return FALSE if failed
+ */
+static bool cube_write_spool(FITSstream *s){
+    int bitpix = s->hdr->dtype, st = 0;
+    size_t sz = s->hdr->width * s->hdr->height;
+    quantpars q;
+    bool ret = FALSE;
+    if(bitpix == USHORT_IMG) bitpix = SHORT_IMG; // BZERO would be selected by data range
+    quant_scale(bitpix, s->qmin, s->qmax, s->qintegral, s->qnans > 0, &q);
+    fits_delete_key(s->fp, "BLANK", &st); // BLANK of original integer data has no sense now
+    if(!write_quantpars(s->fp, &q, ZCMP_NONE)) return FALSE;
+    Item *data = MALLOC(Item, sz);
+    rewind(s->spool);
+    for(long p = 0; p < s->plane; ++p){
+        if(fread(data, sizeof(Item), sz, s->spool) != sz){
+            WARN(_("Can't read temporary file"));
+            goto ret;
+        }
+        long fpix[3] = {1, 1, p + 1};
+        void *buf = quant_data(data, sz, bitpix, &q);
+        TRYFITS(fits_write_pix, s->fp, pix_datatype(bitpix), fpix, (LONGLONG)sz, buf);
+        FREE(buf);
+        if(fitsstatus) goto ret;
+    }
+    ret = TRUE;
+ret:
+    FREE(data);
+    return ret;
+}
+
+/**
+ * write next strip
+ * @param s     - stream opened by stream_create
+ * @param strip - image with strip (and halo)
+ * @param top   - index of strip's first row in 'strip'
+ * @param nrows - amount of rows to write
+ * @return FALSE if failed
+ */
+bool stream_write_strip(FITSstream *s, IMAGE *strip, int top, int nrows){
+    if(!s || !strip || strip->width != s->hdr->width) return FALSE;
+    if(nrows > s->hdr->height - s->y0) nrows = s->hdr->height - s->y0;
+    if(nrows < 1) return FALSE;
+    long fpix[2] = {1, s->y0 + 1};
+    size_t pixsz = strip->pix ? pix_size(strip->dtype) : sizeof(Item);
+    TRYFITS(fits_write_pix, s->fp, img_datatype(strip), fpix, (LONGLONG)nrows * strip->width,
+        (uint8_t*)PIXPTR(strip) + top * strip->width * pixsz);
+    if(fitsstatus) return FALSE;
+    s->y0 += nrows;
+    return TRUE;
+}
+
+/**
+ * close stream (for write stream tables would be saved first) & free its memory
+ */
+bool stream_close(FITSstream **s){
+    if(!s || !*s) return FALSE;
+    FITSstream *str = *s;
+    bool ret = TRUE;
+    if(str->writing){
+        if(str->spool){
+            ret = cube_write_spool(str);
+            fclose(str->spool);
+        }
+        if(str->hdr->tables && !G.deltabs) table_write(str->hdr, str->fp);
+        ret = close_file(str->fp, ret);
+    }else{
+        FITSFUN(fits_close_file, str->fp);
+        if(fitsstatus) ret = FALSE;
+    }
+    imfree(&str->hdr);
+    FREE(*s);
+    return ret;
+}
+
 /*
  * Different file functions
  */
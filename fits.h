@@ -27,6 +27,7 @@
 #include <fitsio.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#include "usefull_macros.h"
 
 typedef double Item;
 
@@ -40,10 +41,31 @@ cfitsio.h BITPIX code values for FITS image types:
 #define DOUBLE_IMG  -64
 */
 
-typedef struct klist_{
-	char *record;
-	struct klist_ *next;
-	struct klist_ *last;
+// header card stored in arena of KeyList
+typedef struct{
+	char record[FLEN_CARD];	// card text
+	int keylen;				// length of keyword at the beginning of 'record'
+	int next;				// index of next card with the same keyword or -1
+	bool deleted;			// card was removed from header
+} KeyCard;
+
+// hash index entry: chain of cards with the same keyword
+typedef struct{
+	uint32_t hash;			// hash of keyword
+	int name;				// index of first card with this keyword (<0 for empty or removed entry)
+	int last;				// index of last card with this keyword
+} KeyIndex;
+
+// FITS header: cards in order of adding are stored in one array,
+// exact keyword names are indexed by hash table with open addressing
+typedef struct{
+	KeyCard *cards;			// arena of cards (including removed)
+	int ncards;				// amount of cards in arena
+	int nalloc;				// allocated size of arena
+	int ndeleted;			// amount of removed cards
+	KeyIndex *index;		// hash table
+	int isize;				// size of hash table (power of 2)
+	int iused;				// amount of occupied entries of hash table
 } KeyList;
 
 #define FLEN_FORMAT	(12)
@@ -52,7 +74,8 @@ typedef struct{
 	void *contents;				// contents of table
 	int coltype;				// type of columns
 	long width;					// data width
-	long repeat;				// amount of rows -> 'contents' size = width*repeat
+	long repeat;				// amount of rows -> 'contents' size = width*repeat*nelem
+	long nelem;					// elements per row (vector columns), 0 or 1 for scalar
 	char colname[FLEN_KEYWORD];	// column name (arg ttype of fits_create_tbl)
 	char format[FLEN_FORMAT];	// format codes (tform)
 	char unit[FLEN_CARD];		// units (tunit)
@@ -70,25 +93,62 @@ typedef struct{
 	FITStable **tables;	// array of pointer to tables
 } FITStables;
 
+// source of image pixels which aren't read yet
 typedef struct{
+	char *filename;		// file to read data from by cfitsio
+	int hdu;			// number of image HDU
+	mmapbuf *map;		// or mmap'ed file (then 'filename' isn't used)
+	size_t offset;		// offset of data in 'map'
+	int bitpix;			// BITPIX of data in 'map'
+} lazysrc;
+
+// Fourier transform of padded image, it is kept for next convolutions of the same image
+typedef struct{
+	int nx, ny;			// size of padded image
+	void *data;			// r2c transform (ny rows of nx/2+1 complex values)
+	void (*release)(void *data); // function to free 'data'
+} imgspectrum;
+
+typedef struct image_{
 	int width;			// width
 	int height;			// height
-	int dtype;			// data type
+	int dtype;			// data type (equivalent BITPIX)
 	//int lasthdu;		// last filled HDU number
-	Item *data;			// picture data
+	void *pix;			// picture data in native type 'dtype' or NULL
+	mmapbuf *map;		// mmap'ed file if 'pix' points into it
+	Item *data;			// picture data widened to double (if 'pix' is NULL)
+	lazysrc *lazy;		// source of data if they aren't read yet (see image_load())
+	imgspectrum *spectrum; // cached spectrum (should be dropped by image_changed() if pixels changed)
 	KeyList *keylist;	// list of options for each key
 	FITStables *tables; // tables from FITS file
+	KeyList *primary;	// header of empty primary HDU of multi-extension file (in first image)
+	struct image_ *next;// next image extension of multi-extension file or NULL
 } IMAGE;
 
+// image read or written by strips of rows (or data cube read or written by planes)
+typedef struct{
+	fitsfile *fp;		// opened file
+	IMAGE *hdr;			// size, type, headers & tables of image (without data)
+	int striph;			// strip height (without halo)
+	int halo;			// amount of extra rows above and below each strip
+	int y0;				// first row of next strip
+	bool writing;		// stream is opened for writing
+	long nplanes;		// amount of planes of data cube (0 for 2-D image)
+	long plane;			// next plane of cube to read or write
+	FILE *spool;		// floating point planes of integer cube waiting for common quantization
+	Item qmin, qmax;	// data range of spooled planes
+	size_t qnans;		// amount of NaNs in spooled planes
+	bool qintegral;		// all spooled values are integer
+} FITSstream;
 
 void list_free(KeyList **list);
-KeyList *list_add_record(KeyList **list, char *rec);
-KeyList *list_find_key(KeyList *list, char *key);
+char *list_add_record(KeyList **list, char *rec);
+char *list_find_key(KeyList *list, char *key);
 void list_remove_key(KeyList **list, char *key);
-KeyList *list_modify_key(KeyList *list, char *key, char *newval);
+char *list_modify_key(KeyList *list, char *key, char *newval);
 void list_remove_records(KeyList **list, char *sample);
 KeyList *list_copy(KeyList *list);
-KeyList *list_get_end(KeyList *list);
+char *list_next(KeyList *list, int *idx);
 void list_print(KeyList *list);
 
 void tablefree(FITStable **tbl);
@@ -102,11 +162,35 @@ void table_print_all(IMAGE *img);
 void imfree(IMAGE **ima);
 IMAGE *readFITS(char *filename, IMAGE **fits);
 bool writeFITS(char *filename, IMAGE *fits);
+void stdout_reserve();
+bool update_header(char *filename, void (*edit)(KeyList **));
 IMAGE *newFITS(size_t h, size_t w, int dtype);
+IMAGE *nativeFITS(size_t h, size_t w, int dtype);
+int pix_datatype(int dtype);
+size_t pix_size(int dtype);
+Item *image_data(IMAGE *img);
+void image_load(IMAGE *img);
+void image_drop(IMAGE *img);
+void *image_pixels(IMAGE *img);
+void lazy_free(lazysrc **src);
+void image_changed(IMAGE *img);
+int parse_bitpix(char *str);
+void set_dtype(IMAGE *img, int dtype);
 IMAGE *similarFITS(IMAGE *in, int dtype);
 IMAGE *copyFITS(IMAGE *in);
 IMAGE *buildFITSfromdat(size_t h, size_t w, int dtype, uint8_t *indata);
 
+FITSstream *stream_open(char *filename, int striph, int halo);
+void stream_rewind(FITSstream *s);
+IMAGE *stream_read_strip(FITSstream *s, int *top, int *nrows);
+FITSstream *stream_create(char *filename, IMAGE *hdr);
+bool stream_write_strip(FITSstream *s, IMAGE *strip, int top, int nrows);
+bool stream_close(FITSstream **s);
+FITSstream *cube_open(char *filename);
+IMAGE *cube_read_plane(FITSstream *s);
+FITSstream *cube_create(char *filename, IMAGE *hdr, long nplanes);
+bool cube_write_plane(FITSstream *s, IMAGE *plane);
+
 extern struct stat filestat;
 char* make_filename(char *buff, size_t buflen, char *prefix, char *suffix);
 bool file_absent(char *name);
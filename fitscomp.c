@@ -0,0 +1,760 @@
+/*
+ * fitscomp.c - reading & writing of tile-compressed FITS images
+ * (compressed images are stored as binary tables by "tiled image compression"
+ *  convention; tiles are compressed & decompressed in parallel)
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "fitscomp.h"
+#include "types.h"
+#include "usefull_macros.h"
+#include "cmdlnopts.h"
+#include "median.h"
+
+#define N_RANDOM		(10000)			// size of random table for subtractive dithering
+#define DITHER_SEED		(1)				// ZDITHER0
+#define ZBLANK_VALUE	(-2147483647)	// stored value of NaNs in quantized data
+#define RICE_BLOCKSIZE	(32)			// BLOCKSIZE of RICE_1
+#define HCOMP_MINTILE	(4)				// minimal tile size for HCOMPRESS_1
+#define GZIP_LEVEL		(1)				// zlib compression level (the same as in cfitsio)
+#define ZERO_VALUE		(-2147483646)	// stored value of zeros for SUBTRACTIVE_DITHER_2
+
+static __thread int fitsstatus = 0;
+
+// Try to run function f with arguments
+#define TRYFITS(f, ...)                         \
+do{ fitsstatus = 0;                             \
+	f(__VA_ARGS__, &fitsstatus);                \
+	if(fitsstatus){                             \
+		fits_report_error(stderr, fitsstatus);} \
+}while(0)
+
+static const char *zcmpnames[] = {
+	[ZCMP_RICE] = "RICE_1",
+	[ZCMP_GZIP] = "GZIP_1",
+	[ZCMP_HCOMPRESS] = "HCOMPRESS_1"
+};
+
+// random numbers for subtractive dithering
+static float rand_value[N_RANDOM];
+static bool rand_ready = FALSE;
+
+/**
+ * fill table of random numbers for subtractive dithering
+ * (Park & Miller generator, the same sequence as in cfitsio)
+ */
+static void init_random(){
+	#pragma omp critical (init_random)
+	if(!rand_ready){
+		double a = 16807., m = 2147483647., seed = 1., temp;
+		for(int i = 0; i < N_RANDOM; ++i){
+			temp = a * seed;
+			seed = temp - m * (int)(temp / m);
+			rand_value[i] = (float)(seed / m);
+		}
+		rand_ready = TRUE;
+	}
+}
+
+/**
+ * fill compression parameters by command line arguments
+ * @param c (o) - parameters (c->type == ZCMP_NONE if there's no compression)
+ * @return FALSE if parameters are wrong
+ */
+bool fitscomp_parse(FITScompress *c){
+	memset(c, 0, sizeof(FITScompress));
+	if(!G.zcomp) return TRUE;
+	if(strcasecmp(G.zcomp, "rice") == 0) c->type = ZCMP_RICE;
+	else if(strcasecmp(G.zcomp, "gzip") == 0) c->type = ZCMP_GZIP;
+	else if(strcasecmp(G.zcomp, "hcompress") == 0) c->type = ZCMP_HCOMPRESS;
+	else{
+		WARNX(_("Unknown compression type: %s"), G.zcomp);
+		return FALSE;
+	}
+	if(G.ztile && (sscanf(G.ztile, "%dx%d", &c->tilew, &c->tileh) != 2 || c->tilew < 1 || c->tileh < 1)){
+		WARNX(_("Wrong tile size: %s"), G.ztile);
+		return FALSE;
+	}
+	if(G.zquant < 0.){
+		WARNX(_("Quantization level can't be negative"));
+		return FALSE;
+	}
+	c->q = G.zquant;
+	return TRUE;
+}
+
+/**
+ * check whether image with data type 'bitpix' & buffer type 'datatype' can be compressed
+ */
+bool fitscomp_supported(int bitpix, int datatype){
+	switch(datatype){
+		case TBYTE:
+		case TSHORT:
+		case TUSHORT:
+		case TINT:
+			return TRUE;
+		case TFLOAT:
+		case TDOUBLE:
+			return (bitpix == FLOAT_IMG || bitpix == DOUBLE_IMG);
+		default:
+			return FALSE;
+	}
+}
+
+// amount of bytes per stored pixel
+static int stored_bytepix(int bitpix, FITScompress *c){
+	if(bitpix < 0 && c->q > 0.) return 4; // quantized
+	switch(bitpix){
+		case BYTE_IMG:   return 1;
+		case SHORT_IMG:
+		case USHORT_IMG: return 2;
+		case DOUBLE_IMG: return 8;
+		default:         return 4;
+	}
+}
+
+/**
+ * create binary table for compressed image & write its keywords
+ * @param fp     - opened file
+ * @param bitpix - data type of image
+ * @param w, h   - image size
+ * @param c (io) - compression parameters (tile size would be corrected)
+ * @return FALSE if failed
+ */
+bool fitscomp_create(fitsfile *fp, int bitpix, int w, int h, FITScompress *c){
+	FNAME();
+	bool quant = (bitpix < 0 && c->q > 0.);
+	if(bitpix < 0 && !quant && c->type != ZCMP_GZIP){
+		WARNX(_("Lossless compression of floating point data is possible only with gzip"));
+		c->type = ZCMP_GZIP;
+	}
+	c->tilew = c->tilew ? MIN(c->tilew, w) : w;
+	if(!c->tileh) c->tileh = (c->type == ZCMP_HCOMPRESS) ? 16 : 1;
+	c->tileh = MIN(c->tileh, h);
+	if(c->type == ZCMP_HCOMPRESS && (c->tilew < HCOMP_MINTILE || c->tileh < HCOMP_MINTILE)){
+		WARNX(_("HCOMPRESS tiles should be not less than 4x4"));
+		return FALSE;
+	}
+	long ntiles = (long)((w + c->tilew - 1) / c->tilew) * ((h + c->tileh - 1) / c->tileh);
+	char *ttype[] = {"COMPRESSED_DATA", "ZSCALE", "ZZERO"};
+	char *tform[] = {"1PB", "1D", "1D"};
+	TRYFITS(fits_create_tbl, fp, BINARY_TBL, ntiles, quant ? 3 : 1, ttype, tform, NULL, "COMPRESSED_IMAGE");
+	if(fitsstatus) return FALSE;
+	int t = 1, zbitpix = (bitpix == USHORT_IMG) ? SHORT_IMG : bitpix, naxis = 2;
+	#define WRKEY(type, key, val, comment) do{if(!fitsstatus) fits_write_key(fp, type, key, val, comment, &fitsstatus);}while(0)
+	fitsstatus = 0;
+	WRKEY(TLOGICAL, "ZIMAGE", &t, "extension contains compressed image");
+	WRKEY(TLOGICAL, "ZSIMPLE", &t, "file does conform to FITS standard");
+	WRKEY(TINT, "ZBITPIX", &zbitpix, "data type of original image");
+	WRKEY(TINT, "ZNAXIS", &naxis, "dimension of original image");
+	WRKEY(TINT, "ZNAXIS1", &w, "length of original image axis");
+	WRKEY(TINT, "ZNAXIS2", &h, "length of original image axis");
+	WRKEY(TINT, "ZTILE1", &c->tilew, "size of tiles to be compressed");
+	WRKEY(TINT, "ZTILE2", &c->tileh, "size of tiles to be compressed");
+	WRKEY(TSTRING, "ZCMPTYPE", (char*)zcmpnames[c->type], "compression algorithm");
+	if(c->type == ZCMP_RICE){
+		int blocksize = RICE_BLOCKSIZE, bytepix = stored_bytepix(bitpix, c);
+		WRKEY(TSTRING, "ZNAME1", "BLOCKSIZE", "compression block size");
+		WRKEY(TINT, "ZVAL1", &blocksize, "pixels per block");
+		WRKEY(TSTRING, "ZNAME2", "BYTEPIX", "bytes per pixel (1, 2, 4, or 8)");
+		WRKEY(TINT, "ZVAL2", &bytepix, "bytes per pixel (1, 2, 4, or 8)");
+	}else if(c->type == ZCMP_HCOMPRESS){
+		int zero = 0;
+		WRKEY(TSTRING, "ZNAME1", "SCALE", "HCOMPRESS scale factor");
+		WRKEY(TINT, "ZVAL1", &zero, "HCOMPRESS scale factor");
+		WRKEY(TSTRING, "ZNAME2", "SMOOTH", "HCOMPRESS smooth option");
+		WRKEY(TINT, "ZVAL2", &zero, "HCOMPRESS smooth option");
+	}
+	if(quant){
+		int seed = DITHER_SEED, blank = ZBLANK_VALUE;
+		WRKEY(TSTRING, "ZQUANTIZ", "SUBTRACTIVE_DITHER_1", "pixel quantization algorithm");
+		WRKEY(TINT, "ZDITHER0", &seed, "dithering offset when quantizing floats");
+		WRKEY(TINT, "ZBLANK", &blank, "null value in the compressed integer array");
+	}else if(bitpix < 0)
+		WRKEY(TSTRING, "ZQUANTIZ", "NONE", "floating point data are not quantized");
+	if(bitpix == USHORT_IMG){ // unsigned short are stored as signed with offset
+		double bscale = 1., bzero = 32768.;
+		WRKEY(TDOUBLE, "BSCALE", &bscale, NULL);
+		WRKEY(TDOUBLE, "BZERO", &bzero, "offset data range to that of unsigned short");
+	}
+	#undef WRKEY
+	if(fitsstatus){
+		fits_report_error(stderr, fitsstatus);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * convert 'n' values of 'bytepix' bytes each between native & big-endian order (for GZIP_1)
+ */
+static void swap_bigendian(uint8_t *buf, size_t n, int bytepix){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	size_t i;
+	switch(bytepix){
+		case 2:{
+			uint16_t *p = (uint16_t*)buf;
+			for(i = 0; i < n; ++i) p[i] = __builtin_bswap16(p[i]);
+		}
+		break;
+		case 4:{
+			uint32_t *p = (uint32_t*)buf;
+			for(i = 0; i < n; ++i) p[i] = __builtin_bswap32(p[i]);
+		}
+		break;
+		case 8:{
+			uint64_t *p = (uint64_t*)buf;
+			for(i = 0; i < n; ++i) p[i] = __builtin_bswap64(p[i]);
+		}
+		break;
+		default:
+		break;
+	}
+#else
+	(void)buf; (void)n; (void)bytepix;
+#endif
+}
+
+/**
+ * compress buffer 'in' of length 'len' by gzip
+ * @param clen (o) - length of compressed data
+ * @return allocated compressed data or NULL
+ */
+static uint8_t *gzip_tile(uint8_t *in, size_t len, long *clen){
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+	size_t cap = deflateBound(&zs, len) + 32; // + gzip header & trailer
+	uint8_t *out = MALLOC(uint8_t, cap);
+	zs.next_in = in;
+	zs.avail_in = len;
+	zs.next_out = out;
+	zs.avail_out = cap;
+	if(deflate(&zs, Z_FINISH) != Z_STREAM_END){
+		deflateEnd(&zs);
+		FREE(out);
+		return NULL;
+	}
+	*clen = (long)zs.total_out;
+	deflateEnd(&zs);
+	return out;
+}
+
+/**
+ * quantize floating point tile 'data' of size 'n' with subtractive dithering
+ * @param tileno       - number of tile (from 0)
+ * @param q            - quantization level: step = noise / q
+ * @param out (o)      - quantized data
+ * @param scale, zero (o) - ZSCALE & ZZERO of tile
+ */
+static void quantize_tile(Item *data, size_t n, long tileno, double q, int32_t *out,
+						double *scale, double *zero){
+	size_t i, ndiff = 0;
+	Item mn = DBL_MAX, mx = -DBL_MAX, noise = 0., delta;
+	for(i = 0; i < n; ++i){
+		Item v = data[i];
+		if(isnan(v)) continue;
+		if(v < mn) mn = v;
+		if(v > mx) mx = v;
+	}
+	if(mn > mx) mn = mx = 0.; // all pixels are NaN
+	// noise estimation by median of second differences (as "noise3" of cfitsio)
+	if(n > 4){
+		Item *diff = MALLOC(Item, n - 4);
+		for(i = 2; i < n - 2; ++i){
+			Item d = 2.*data[i] - data[i-2] - data[i+2];
+			if(!isnan(d)) diff[ndiff++] = fabs(d);
+		}
+		if(ndiff) noise = 0.6052697 * quick_select(diff, (int)ndiff);
+		FREE(diff);
+	}
+	delta = noise / q;
+	if(delta <= 0.) delta = 1.;
+	if((mx - mn) / delta > 2147483000.) delta = (mx - mn) / 2147483000.;
+	int iseed = (int)((tileno + DITHER_SEED - 1) % N_RANDOM);
+	int nextrand = (int)(rand_value[iseed] * 500.);
+	for(i = 0; i < n; ++i){
+		Item v = data[i];
+		if(isnan(v)) out[i] = ZBLANK_VALUE;
+		else out[i] = (int32_t)round((v - mn) / delta + rand_value[nextrand] - 0.5);
+		if(++nextrand == N_RANDOM){
+			if(++iseed == N_RANDOM) iseed = 0;
+			nextrand = (int)(rand_value[iseed] * 500.);
+		}
+	}
+	*scale = delta;
+	*zero = mn;
+}
+
+/**
+ * compress one tile
+ * @param data     - image data
+ * @param datatype - type of 'data'
+ * @param bitpix   - data type of image
+ * @param w        - image width
+ * @param x0, y0   - tile position
+ * @param nx, ny   - tile size
+ * @param tileno   - tile number (from 0)
+ * @param c        - compression parameters
+ * @param clen (o) - length of compressed data
+ * @param scale, zero (o) - ZSCALE/ZZERO for quantized data
+ * @return allocated compressed tile or NULL if failed
+ */
+static uint8_t *compress_tile(void *data, int datatype, int bitpix, int w, int x0, int y0,
+					int nx, int ny, long tileno, FITScompress *c, long *clen,
+					double *scale, double *zero){
+	size_t i, n = (size_t)nx * ny;
+	int bytepix = stored_bytepix(bitpix, c);
+	uint8_t *tile = MALLOC(uint8_t, n * bytepix), *out = NULL;
+	// copy tile into contiguous buffer 'dst' of type 'otype'
+	#define GATHER(dst, stype, otype, conv) do{ otype *o = (otype*)(dst);      \
+		for(int y = 0; y < ny; ++y){                                            \
+			stype *iptr = (stype*)data + (size_t)(y0 + y) * w + x0;             \
+			for(int x = 0; x < nx; ++x) *o++ = (otype)conv(iptr[x]);            \
+		}}while(0)
+	#define ASIS(x)		(x)
+	#define UNSIGN(x)	((int)(x) - 32768)
+	switch(datatype){
+		case TBYTE:   GATHER(tile, uint8_t, uint8_t, ASIS); break;
+		case TSHORT:  GATHER(tile, int16_t, int16_t, ASIS); break;
+		case TUSHORT: GATHER(tile, uint16_t, int16_t, UNSIGN); break;
+		case TINT:    GATHER(tile, int32_t, int32_t, ASIS); break;
+		case TFLOAT:
+		case TDOUBLE:
+			if(bitpix < 0 && c->q > 0.){ // quantize
+				Item *dtile = MALLOC(Item, n);
+				if(datatype == TFLOAT) GATHER(dtile, float, Item, ASIS);
+				else GATHER(dtile, Item, Item, ASIS);
+				quantize_tile(dtile, n, tileno, c->q, (int32_t*)tile, scale, zero);
+				FREE(dtile);
+			}else if(bytepix == 4){ // lossless float
+				if(datatype == TFLOAT) GATHER(tile, float, float, ASIS);
+				else GATHER(tile, Item, float, ASIS);
+			}else{ // lossless double
+				if(datatype == TFLOAT) GATHER(tile, float, Item, ASIS);
+				else GATHER(tile, Item, Item, ASIS);
+			}
+		break;
+		default:
+			FREE(tile);
+			return NULL;
+	}
+	#undef GATHER
+	#undef ASIS
+	#undef UNSIGN
+	switch(c->type){
+		case ZCMP_RICE:{
+			int l, cmax = (int)(n * bytepix + n / 4 + 256);
+			out = MALLOC(uint8_t, cmax);
+			if(bytepix == 1) l = fits_rcomp_byte((signed char*)tile, (int)n, out, cmax, RICE_BLOCKSIZE);
+			else if(bytepix == 2) l = fits_rcomp_short((short*)tile, (int)n, out, cmax, RICE_BLOCKSIZE);
+			else l = fits_rcomp((int*)tile, (int)n, out, cmax, RICE_BLOCKSIZE);
+			if(l <= 0) FREE(out);
+			else *clen = l;
+		}
+		break;
+		case ZCMP_GZIP:
+			swap_bigendian(tile, n, bytepix);
+			out = gzip_tile(tile, n * bytepix, clen);
+		break;
+		case ZCMP_HCOMPRESS:{
+			int *ibuf = (int*)tile, st = 0;
+			if(bytepix == 1){
+				ibuf = MALLOC(int, n);
+				for(i = 0; i < n; ++i) ibuf[i] = tile[i];
+			}else if(bytepix == 2){
+				ibuf = MALLOC(int, n);
+				for(i = 0; i < n; ++i) ibuf[i] = ((int16_t*)tile)[i];
+			}
+			long nbytes = (long)(n * sizeof(int) * 3 / 2 + 1024);
+			out = MALLOC(uint8_t, nbytes);
+			// hcompress of cfitsio uses static variables, so it can't be run in parallel (other tiles
+			// are gathered & converted meanwhile)
+			#pragma omp critical (hcompress)
+			fits_hcompress(ibuf, nx, ny, 0, (char*)out, &nbytes, &st);
+			if(st) FREE(out);
+			else *clen = nbytes;
+			if(ibuf != (int*)tile) FREE(ibuf);
+		}
+		break;
+		default:
+		break;
+	}
+	FREE(tile);
+	return out;
+}
+
+/**
+ * compress image by tiles (in parallel) & write them into table created by fitscomp_create
+ * @param fp       - opened file (current HDU is table of compressed image)
+ * @param data     - image data
+ * @param datatype - type of 'data'
+ * @param bitpix   - data type of image
+ * @param w, h     - image size
+ * @param c        - compression parameters
+ * @return FALSE if failed
+ */
+bool fitscomp_write(fitsfile *fp, void *data, int datatype, int bitpix, int w, int h, FITScompress *c){
+	FNAME();
+	int tw = c->tilew, th = c->tileh, ntx = (w + tw - 1) / tw, nty = (h + th - 1) / th;
+	long t, ntiles = (long)ntx * nty;
+	bool quant = (bitpix < 0 && c->q > 0.), failed = FALSE;
+	uint8_t **cdata = MALLOC(uint8_t*, ntiles);
+	long *clen = MALLOC(long, ntiles);
+	double *zscale = NULL, *zzero = NULL;
+	if(quant){
+		init_random();
+		zscale = MALLOC(double, ntiles);
+		zzero = MALLOC(double, ntiles);
+	}
+#ifdef EBUG
+	double t0 = dtime();
+#endif
+	OMP_FOR(schedule(dynamic))
+	for(t = 0; t < ntiles; ++t){
+		int x0 = (t % ntx) * tw, y0 = (t / ntx) * th;
+		double scale = 1., zero = 0.;
+		cdata[t] = compress_tile(data, datatype, bitpix, w, x0, y0, MIN(tw, w - x0),
+					MIN(th, h - y0), t, c, &clen[t], &scale, &zero);
+		if(!cdata[t]) failed = TRUE;
+		if(quant){
+			zscale[t] = scale;
+			zzero[t] = zero;
+		}
+	}
+	DBG("%ld tiles compressed by %s, time=%gs", ntiles, zcmpnames[c->type], dtime() - t0);
+	fitsstatus = 0;
+	if(failed) WARNX(_("Can't compress image tiles"));
+	else{
+		for(t = 0; t < ntiles && !fitsstatus; ++t)
+			TRYFITS(fits_write_col, fp, TBYTE, 1, t + 1, 1, clen[t], cdata[t]);
+		if(quant && !fitsstatus)
+			TRYFITS(fits_write_col, fp, TDOUBLE, 2, 1, 1, ntiles, zscale);
+		if(quant && !fitsstatus)
+			TRYFITS(fits_write_col, fp, TDOUBLE, 3, 1, 1, ntiles, zzero);
+	}
+	for(t = 0; t < ntiles; ++t) FREE(cdata[t]);
+	FREE(cdata);
+	FREE(clen);
+	FREE(zscale);
+	FREE(zzero);
+	return !(failed || fitsstatus);
+}
+
+/**
+ * check whether header record 'rec' of compressed image HDU describes
+ * the binary table or compression (it shouldn't be copied to the output image)
+ */
+bool fitscomp_key(char *rec){
+	static const char *keys[] = {"XTENSION", "PCOUNT", "GCOUNT", "TFIELDS", "TTYPE", "TFORM",
+		"THEAP", "CHECKSUM", "DATASUM", "ZIMAGE", "ZSIMPLE", "ZTENSION", "ZBITPIX", "ZNAXIS",
+		"ZTILE", "ZCMPTYPE", "ZNAME", "ZVAL", "ZQUANTIZ", "ZDITHER0", "ZBLANK", "ZEXTEND",
+		"ZPCOUNT", "ZGCOUNT", "ZHECKSUM", "ZDATASUM", "ZMASKCMP", "ZTHEAP", NULL};
+	for(const char **k = keys; *k; ++k)
+		if(strncmp(rec, *k, strlen(*k)) == 0) return TRUE;
+	if(strncmp(rec, "EXTNAME = 'COMPRESSED_IMAGE'", 28) == 0) return TRUE;
+	return FALSE;
+}
+
+// quantization of floating point data
+enum{
+	ZQ_NONE = 0,	// not quantized
+	ZQ_NODITHER,	// NO_DITHER
+	ZQ_DITHER1,		// SUBTRACTIVE_DITHER_1
+	ZQ_DITHER2		// SUBTRACTIVE_DITHER_2
+};
+
+// parameters of compressed image HDU
+typedef struct{
+	ZCmpType type;		// compression algorithm
+	int zbitpix;		// data type of original image
+	int w, h;			// image size
+	int tilew, tileh;	// tile size
+	int blocksize;		// RICE_1 block size
+	int bytepix;		// RICE_1 bytes per pixel
+	int quant;			// quantization (ZQ_xx)
+	int dither0;		// ZDITHER0
+	bool hasblank;		// there's ZBLANK or BLANK keyword
+	long zblank;		// stored value of undefined pixels
+	double bscale;		// BSCALE
+	double bzero;		// BZERO
+	int datacol;		// number of COMPRESSED_DATA column
+	int scalecol;		// number of ZSCALE column
+	int zerocol;		// number of ZZERO column
+} zimage;
+
+// read optional keyword 'key', return FALSE if it is absent
+static bool rdkey(fitsfile *fp, int type, char *key, void *val){
+	int st = 0;
+	fits_read_key(fp, type, key, val, NULL, &st);
+	return (st == 0);
+}
+
+/**
+ * read parameters of compressed image from current HDU
+ * @return FALSE if image can't be decompressed by us
+ */
+static bool read_zparams(fitsfile *fp, zimage *z){
+	char val[FLEN_VALUE], key[FLEN_KEYWORD];
+	int i, naxis = 0, st;
+	memset(z, 0, sizeof(zimage));
+	#define GETCOL(name, n) (st = 0, fits_get_colnum(fp, CASEINSEN, name, n, &st) == 0)
+	if(!rdkey(fp, TSTRING, "ZCMPTYPE", val)) return FALSE;
+	for(i = ZCMP_RICE; i <= ZCMP_HCOMPRESS; ++i)
+		if(strcmp(val, zcmpnames[i]) == 0) z->type = i;
+	if(strcmp(val, "RICE_ONE") == 0) z->type = ZCMP_RICE;
+	if(z->type == ZCMP_NONE){
+		DBG("unsupported compression: %s", val);
+		return FALSE;
+	}
+	if(!rdkey(fp, TINT, "ZBITPIX", &z->zbitpix) || !rdkey(fp, TINT, "ZNAXIS", &naxis) || naxis != 2
+		|| !rdkey(fp, TINT, "ZNAXIS1", &z->w) || !rdkey(fp, TINT, "ZNAXIS2", &z->h))
+		return FALSE;
+	if(z->zbitpix == LONGLONG_IMG) return FALSE;
+	z->tilew = z->w; z->tileh = 1;
+	rdkey(fp, TINT, "ZTILE1", &z->tilew);
+	rdkey(fp, TINT, "ZTILE2", &z->tileh);
+	if(z->tilew < 1 || z->tileh < 1) return FALSE;
+	z->blocksize = RICE_BLOCKSIZE; z->bytepix = 4;
+	for(i = 1; ; ++i){
+		snprintf(key, FLEN_KEYWORD, "ZNAME%d", i);
+		if(!rdkey(fp, TSTRING, key, val)) break;
+		snprintf(key, FLEN_KEYWORD, "ZVAL%d", i);
+		if(strcmp(val, "BLOCKSIZE") == 0) rdkey(fp, TINT, key, &z->blocksize);
+		else if(strcmp(val, "BYTEPIX") == 0) rdkey(fp, TINT, key, &z->bytepix);
+	}
+	z->bscale = 1.;
+	rdkey(fp, TDOUBLE, "BSCALE", &z->bscale);
+	rdkey(fp, TDOUBLE, "BZERO", &z->bzero);
+	z->hasblank = rdkey(fp, TLONG, "ZBLANK", &z->zblank) || rdkey(fp, TLONG, "BLANK", &z->zblank);
+	if(!GETCOL("COMPRESSED_DATA", &z->datacol)) return FALSE;
+	if(z->zbitpix < 0 && GETCOL("ZSCALE", &z->scalecol) && GETCOL("ZZERO", &z->zerocol)){
+		z->quant = ZQ_NODITHER;
+		z->dither0 = 1;
+		if(rdkey(fp, TSTRING, "ZQUANTIZ", val)){
+			if(strcmp(val, "SUBTRACTIVE_DITHER_1") == 0) z->quant = ZQ_DITHER1;
+			else if(strcmp(val, "SUBTRACTIVE_DITHER_2") == 0) z->quant = ZQ_DITHER2;
+		}
+		rdkey(fp, TINT, "ZDITHER0", &z->dither0);
+	}else if(z->zbitpix < 0){
+		// not quantized floating point image is lossless only as gzipped bytes; scaling by
+		// ZSCALE/ZZERO keywords (or by one column of them) is left for cfitsio
+		double d;
+		if(z->type != ZCMP_GZIP || rdkey(fp, TDOUBLE, "ZSCALE", &d) || rdkey(fp, TDOUBLE, "ZZERO", &d))
+			return FALSE;
+	}
+	if(GETCOL("ZBLANK", &i)) return FALSE; // null values in table column aren't supported
+	#undef GETCOL
+	return TRUE;
+}
+
+/**
+ * decompress gzipped buffer 'in' of length 'len' into 'out' of length 'olen'
+ */
+static bool gunzip_tile(uint8_t *in, long len, uint8_t *out, size_t olen){
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, MAX_WBITS + 32) != Z_OK) return FALSE;
+	zs.next_in = in;
+	zs.avail_in = len;
+	zs.next_out = out;
+	zs.avail_out = olen;
+	bool ok = (inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out == olen);
+	inflateEnd(&zs);
+	return ok;
+}
+
+/**
+ * decompress one tile into image buffer
+ * @param cdata, clen - compressed data & its length
+ * @param z           - compressed image parameters
+ * @param tileno      - tile number (from 0)
+ * @param x0, y0      - tile position
+ * @param nx, ny      - tile size
+ * @param zscale, zzero - ZSCALE/ZZERO for quantized data
+ * @param out         - image buffer
+ * @param datatype    - type of 'out'
+ * @param nnull (o)   - amount of undefined pixels
+ * @return FALSE if failed
+ */
+static bool decompress_tile(uint8_t *cdata, long clen, zimage *z, long tileno, int x0, int y0,
+					int nx, int ny, double zscale, double zzero, void *out, int datatype,
+					long *nnull){
+	size_t i, n = (size_t)nx * ny;
+	int bytepix;
+	bool ok = FALSE, isint = (datatype != TFLOAT && datatype != TDOUBLE);
+	if(z->type == ZCMP_RICE) bytepix = z->bytepix;
+	else if(z->type == ZCMP_HCOMPRESS || z->quant) bytepix = 4;
+	else bytepix = abs(z->zbitpix) / 8;
+	uint8_t *raw = MALLOC(uint8_t, n * MAX(bytepix, 4));
+	switch(z->type){
+		case ZCMP_RICE:
+			if(bytepix == 1) ok = !fits_rdecomp_byte(cdata, (int)clen, raw, (int)n, z->blocksize);
+			else if(bytepix == 2) ok = !fits_rdecomp_short(cdata, (int)clen, (unsigned short*)raw, (int)n, z->blocksize);
+			else if(bytepix == 4) ok = !fits_rdecomp(cdata, (int)clen, (unsigned int*)raw, (int)n, z->blocksize);
+		break;
+		case ZCMP_GZIP:
+			ok = gunzip_tile(cdata, clen, raw, n * bytepix);
+			swap_bigendian(raw, n, bytepix);
+		break;
+		case ZCMP_HCOMPRESS:{
+			int hx = 0, hy = 0, scale = 0, st = 0;
+			// hdecompress uses static variables, so it can't be run in parallel
+			#pragma omp critical (hcompress)
+			fits_hdecompress(cdata, 0, (int*)raw, &hy, &hx, &scale, &st);
+			ok = (!st && (size_t)hx * hy == n);
+		}
+		break;
+		default:
+		break;
+	}
+	if(!ok){
+		FREE(raw);
+		return FALSE;
+	}
+	// physical values of pixels
+	Item *val = MALLOC(Item, n);
+	long nulls = 0;
+	if(z->zbitpix < 0 && !z->quant){ // lossless floating point
+		if(bytepix == 4) for(i = 0; i < n; ++i) val[i] = ((float*)raw)[i];
+		else memcpy(val, raw, n * sizeof(Item));
+	}else{
+		int iseed = (int)((tileno + z->dither0 - 1) % N_RANDOM);
+		int nextrand = (int)(rand_value[iseed] * 500.);
+		for(i = 0; i < n; ++i){
+			long s;
+			if(bytepix == 1) s = raw[i];
+			else if(bytepix == 2) s = ((int16_t*)raw)[i];
+			else s = ((int32_t*)raw)[i];
+			if(z->hasblank && s == z->zblank && !isint){
+				val[i] = NAN;
+				++nulls;
+			}else if(!z->quant) val[i] = z->bzero + z->bscale * s;
+			else if(z->quant == ZQ_NODITHER) val[i] = s * zscale + zzero;
+			else if(z->quant == ZQ_DITHER2 && s == ZERO_VALUE) val[i] = 0.;
+			else val[i] = (s - rand_value[nextrand] + 0.5) * zscale + zzero;
+			if(z->quant >= ZQ_DITHER1 && ++nextrand == N_RANDOM){
+				if(++iseed == N_RANDOM) iseed = 0;
+				nextrand = (int)(rand_value[iseed] * 500.);
+			}
+		}
+	}
+	FREE(raw);
+	#define SCATTER(otype) do{                                            \
+		for(int y = 0; y < ny; ++y){                                      \
+			otype *o = (otype*)out + (size_t)(y0 + y) * z->w + x0;        \
+			Item *v = &val[(size_t)y * nx];                               \
+			for(int x = 0; x < nx; ++x) o[x] = (otype)v[x];               \
+		}}while(0)
+	switch(datatype){
+		case TBYTE:   SCATTER(uint8_t); break;
+		case TSHORT:  SCATTER(int16_t); break;
+		case TUSHORT: SCATTER(uint16_t); break;
+		case TINT:    SCATTER(int32_t); break;
+		case TFLOAT:  SCATTER(float); break;
+		default:      SCATTER(Item); break;
+	}
+	#undef SCATTER
+	FREE(val);
+	*nnull = nulls;
+	return TRUE;
+}
+
+/**
+ * read tile-compressed image from current HDU, tiles are decompressed in parallel
+ * @param fp        - opened file
+ * @param img       - image with allocated data buffer (native or double)
+ * @param nnull (o) - amount of undefined pixels
+ * @return FALSE if current HDU isn't compressed image or it can't be decompressed by us
+ *         (then it should be read by cfitsio)
+ */
+bool fitscomp_read(fitsfile *fp, IMAGE *img, long *nnull){
+	FNAME();
+	int st = 0;
+	zimage z;
+	if(!fits_is_compressed_image(fp, &st) || st) return FALSE;
+	if(!read_zparams(fp, &z) || z.w != (int)img->width || z.h != (int)img->height) return FALSE;
+	int ntx = (z.w + z.tilew - 1) / z.tilew, nty = (z.h + z.tileh - 1) / z.tileh;
+	int datatype = img->pix ? pix_datatype(img->dtype) : TDOUBLE;
+	long t, ntiles = (long)ntx * nty, nulls = 0;
+	uint8_t **cdata = MALLOC(uint8_t*, ntiles);
+	long *clen = MALLOC(long, ntiles);
+	double *zscale = NULL, *zzero = NULL;
+	bool ok = TRUE, failed = FALSE;
+	void *out = PIXPTR(img);
+	// read compressed tiles
+	for(t = 0; t < ntiles && ok; ++t){
+		long addr;
+		int anynul;
+		fitsstatus = 0;
+		fits_read_descript(fp, z.datacol, t + 1, &clen[t], &addr, &fitsstatus);
+		if(fitsstatus || clen[t] < 1){ // tile isn't compressed
+			ok = FALSE;
+			break;
+		}
+		cdata[t] = MALLOC(uint8_t, clen[t]);
+		fits_read_col(fp, TBYTE, z.datacol, t + 1, 1, clen[t], NULL, cdata[t], &anynul, &fitsstatus);
+		if(fitsstatus) ok = FALSE;
+	}
+	if(ok && z.quant){
+		int anynul;
+		zscale = MALLOC(double, ntiles);
+		zzero = MALLOC(double, ntiles);
+		fitsstatus = 0;
+		fits_read_col(fp, TDOUBLE, z.scalecol, 1, 1, ntiles, NULL, zscale, &anynul, &fitsstatus);
+		fits_read_col(fp, TDOUBLE, z.zerocol, 1, 1, ntiles, NULL, zzero, &anynul, &fitsstatus);
+		if(fitsstatus) ok = FALSE;
+		init_random();
+	}
+	if(ok){
+#ifdef EBUG
+		double t0 = dtime();
+#endif
+		OMP_FOR(schedule(dynamic) reduction(+:nulls))
+		for(t = 0; t < ntiles; ++t){
+			int x0 = (t % ntx) * z.tilew, y0 = (t / ntx) * z.tileh;
+			long nn = 0;
+			if(!decompress_tile(cdata[t], clen[t], &z, t, x0, y0, MIN(z.tilew, z.w - x0),
+					MIN(z.tileh, z.h - y0), zscale ? zscale[t] : 1., zzero ? zzero[t] : 0.,
+					out, datatype, &nn))
+				failed = TRUE;
+			nulls += nn;
+		}
+		DBG("%ld tiles decompressed, time=%gs", ntiles, dtime() - t0);
+		if(failed) ok = FALSE;
+	}
+	for(t = 0; t < ntiles; ++t) FREE(cdata[t]);
+	FREE(cdata);
+	FREE(clen);
+	FREE(zscale);
+	FREE(zzero);
+	fitsstatus = 0;
+	if(!ok){
+		DBG("can't decompress image by tiles");
+		return FALSE;
+	}
+	*nnull = nulls;
+	return TRUE;
+}
@@ -0,0 +1,49 @@
+/*
+ * fitscomp.h - tile-compressed FITS images
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __FITSCOMP_H__
+#define __FITSCOMP_H__
+
+#include "fits.h"
+
+// tile compression algorithms
+typedef enum{
+	ZCMP_NONE = 0,		// no compression
+	ZCMP_RICE,			// RICE_1
+	ZCMP_GZIP,			// GZIP_1
+	ZCMP_HCOMPRESS		// HCOMPRESS_1 (lossless)
+} ZCmpType;
+
+typedef struct{
+	ZCmpType type;		// compression algorithm
+	int tilew;			// tile width (0 - image width)
+	int tileh;			// tile height (0 - one row or 16 rows for HCOMPRESS)
+	double q;			// quantization level of floating point data (0 - lossless)
+} FITScompress;
+
+bool fitscomp_parse(FITScompress *c);
+bool fitscomp_supported(int bitpix, int datatype);
+bool fitscomp_create(fitsfile *fp, int bitpix, int w, int h, FITScompress *c);
+bool fitscomp_write(fitsfile *fp, void *data, int datatype, int bitpix, int w, int h, FITScompress *c);
+bool fitscomp_key(char *rec);
+bool fitscomp_read(fitsfile *fp, IMAGE *img, long *nnull);
+
+#endif // __FITSCOMP_H__
@@ -0,0 +1,287 @@
+/*
+ * fitsmmap.c - reading of plain (uncompressed) FITS images through mmap:
+ * header blocks are parsed here, pixels are converted from big-endian
+ * directly into image buffer (8-bit images are used without copying)
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fitsmmap.h"
+#include "types.h"
+#include "pixtypes.h"
+#include "usefull_macros.h"
+
+#define FITS_BLOCK		(2880)	// size of FITS block
+#define FITS_CARD		(80)	// size of header record
+#define MAX_TABLES		(64)	// max amount of binary tables to read
+
+// parameters of HDU
+typedef struct{
+	char xtension[FLEN_VALUE];	// XTENSION value or empty string for primary HDU
+	int bitpix;					// BITPIX
+	int naxis;					// NAXIS
+	long naxes[3];				// NAXIS1..NAXIS3
+	size_t npix;				// product of all NAXISn
+	long pcount;				// PCOUNT
+	long gcount;				// GCOUNT
+	double bscale;				// BSCALE
+	double bzero;				// BZERO
+	bool scaled;				// there's BSCALE or BZERO
+	bool special;				// random groups or compressed image
+} hduhdr;
+
+// check whether card 'c' contains keyword 'key'
+static bool iskey(const char *c, const char *key){
+	size_t l = strlen(key);
+	if(strncmp(c, key, l)) return FALSE;
+	for(; l < 8; ++l) if(c[l] != ' ') return FALSE;
+	return (c[8] == '=' && c[9] == ' ');
+}
+
+// numeric value of card
+static double cardval(const char *c){
+	char buf[FLEN_CARD];
+	memcpy(buf, c + 10, FITS_CARD - 10);
+	buf[FITS_CARD - 10] = 0;
+	return strtod(buf, NULL);
+}
+
+// string value of card (without quotes & trailing spaces)
+static void cardstr(const char *c, char *val){
+	const char *b = memchr(c + 10, '\'', FITS_CARD - 10), *e;
+	*val = 0;
+	if(!b) return;
+	++b;
+	e = memchr(b, '\'', c + FITS_CARD - b);
+	if(!e) return;
+	while(e > b && e[-1] == ' ') --e;
+	memcpy(val, b, e - b);
+	val[e - b] = 0;
+}
+
+// logical value of card
+static bool cardtrue(const char *c){
+	for(int i = 10; i < FITS_CARD; ++i){
+		if(c[i] == ' ') continue;
+		return (c[i] == 'T');
+	}
+	return FALSE;
+}
+
+/**
+ * parse header of HDU starting at 'ptr' (not more than 'len' bytes)
+ * @param hdu (o)    - HDU parameters
+ * @param keys (io)  - list of header records (NULL if we don't need them)
+ * @return length of header (in bytes) or 0 if it is wrong
+ */
+static size_t parse_header(char *ptr, size_t len, hduhdr *hdu, KeyList **keys){
+	char card[FLEN_CARD];
+	size_t pos;
+	int i;
+	memset(hdu, 0, sizeof(hduhdr));
+	hdu->gcount = 1;
+	hdu->bscale = 1.;
+	for(pos = 0; pos + FITS_CARD <= len; pos += FITS_CARD){
+		char *c = ptr + pos;
+		if(strncmp(c, "END     ", 8) == 0){ // header is over, skip rest of block
+			pos += FITS_CARD;
+			return (pos + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+		}
+		if(iskey(c, "XTENSION")) cardstr(c, hdu->xtension);
+		else if(iskey(c, "BITPIX")) hdu->bitpix = (int)cardval(c);
+		else if(iskey(c, "NAXIS")) hdu->naxis = (int)cardval(c);
+		else if(strncmp(c, "NAXIS", 5) == 0 && c[5] >= '1' && c[5] <= '3' && c[6] == ' ' && c[8] == '=')
+			hdu->naxes[c[5] - '1'] = (long)cardval(c);
+		else if(iskey(c, "PCOUNT")) hdu->pcount = (long)cardval(c);
+		else if(iskey(c, "GCOUNT")) hdu->gcount = (long)cardval(c);
+		else if(iskey(c, "BSCALE")){ hdu->bscale = cardval(c); hdu->scaled = TRUE; }
+		else if(iskey(c, "BZERO")){ hdu->bzero = cardval(c); hdu->scaled = TRUE; }
+		else if(iskey(c, "GROUPS") || iskey(c, "ZIMAGE")) hdu->special |= cardtrue(c);
+		if(keys){ // store record without trailing spaces
+			memcpy(card, c, FITS_CARD);
+			for(i = FITS_CARD; i > 0 && card[i-1] == ' '; --i);
+			card[i] = 0;
+			if(i && !list_add_record(keys, card)) WARNX(_("Can't add record to list"));
+		}
+	}
+	return 0;
+}
+
+// size of data unit of HDU (with padding)
+static size_t data_size(hduhdr *hdu){
+	if(hdu->naxis < 1 || hdu->naxis > 999) return 0;
+	size_t npix = 1;
+	int i;
+	for(i = 0; i < hdu->naxis && i < 3; ++i) npix *= hdu->naxes[i];
+	if(hdu->naxis > 3) return (size_t)-1; // can't compute, don't go further
+	hdu->npix = npix;
+	size_t sz = abs(hdu->bitpix) / 8 * hdu->gcount * (hdu->pcount + npix);
+	return (sz + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+}
+
+/**
+ * equivalent data type of image with given BITPIX & scaling
+ * @return 0 if we can't convert this data (let cfitsio do it)
+ */
+static int equiv_type(hduhdr *hdu){
+	if(!hdu->scaled || (hdu->bscale == 1. && hdu->bzero == 0.)) return hdu->bitpix;
+	if(hdu->bitpix == SHORT_IMG && hdu->bscale == 1. && hdu->bzero == 32768.) return USHORT_IMG;
+	return 0;
+}
+
+/**
+ * convert 'n' big-endian pixels 'in' of type 'bitpix' into native buffer 'out'
+ * of type 'dtype' (LONGLONG_IMG is converted into double)
+ */
+static void convert_pixels(void *in, void *out, size_t n, int bitpix, int dtype){
+	size_t i;
+	switch(bitpix){
+		case SHORT_IMG:{
+			uint16_t *src = in, *dst = out, x = (dtype == USHORT_IMG) ? 0x8000 : 0;
+			OMP_FOR(simd)
+			for(i = 0; i < n; ++i) dst[i] = __builtin_bswap16(src[i]) ^ x;
+		}
+		break;
+		case LONG_IMG:
+		case FLOAT_IMG:{
+			uint32_t *src = in, *dst = out;
+			OMP_FOR(simd)
+			for(i = 0; i < n; ++i) dst[i] = __builtin_bswap32(src[i]);
+		}
+		break;
+		case DOUBLE_IMG:{
+			uint64_t *src = in, *dst = out;
+			OMP_FOR(simd)
+			for(i = 0; i < n; ++i) dst[i] = __builtin_bswap64(src[i]);
+		}
+		break;
+		case LONGLONG_IMG:{
+			uint64_t *src = in;
+			Item *dst = out;
+			OMP_FOR(simd)
+			for(i = 0; i < n; ++i) dst[i] = (Item)(int64_t)__builtin_bswap64(src[i]);
+		}
+		break;
+		default: // BYTE_IMG
+			memcpy(out, in, n);
+	}
+}
+
+/**
+ * read FITS file through mmap
+ * only plain single images (2-dimensional, without scaling except unsigned short)
+ * are read this way, for all other files NULL is returned (they should be read by cfitsio)
+ * 8-bit data is used as is, other types are converted at first access to pixels (mmap_pixels())
+ * @param filename - name of file
+ * @return 'IMAGE' structure with headers, tables & data or NULL
+ */
+IMAGE *mmapFITS(char *filename){
+	FNAME();
+	struct stat st;
+	// cfitsio extended file names, stdin & so on
+	if(!filename || strpbrk(filename, "[]!") || stat(filename, &st) || !S_ISREG(st.st_mode)
+		|| st.st_size < FITS_BLOCK || access(filename, R_OK))
+		return NULL;
+	mmapbuf *map = My_mmap(filename);
+	char *ptr = map->data;
+	size_t len = map->len, pos = 0, hlen, dlen, dataoff = 0;
+	KeyList *keys = NULL;
+	hduhdr hdu, img;
+	int hdunum = 0, tabhdu[MAX_TABLES], ntabs = 0, dtype = 0;
+	bool found = FALSE, ok = (strncmp(ptr, "SIMPLE  =", 9) == 0);
+	while(ok && pos + FITS_BLOCK <= len){
+		++hdunum;
+		bool isimage = (hdunum == 1);
+		if(!(hlen = parse_header(ptr + pos, len - pos, &hdu, NULL))){
+			ok = FALSE;
+			break;
+		}
+		if(!isimage) isimage = (strcmp(hdu.xtension, "IMAGE") == 0);
+		if(isimage) parse_header(ptr + pos, len - pos, &hdu, &keys); // image headers are stored
+		dlen = data_size(&hdu);
+		if(hdu.special || dlen == (size_t)-1 || pos + hlen + dlen > len){
+			ok = FALSE;
+			break;
+		}
+		if(isimage && found && hdu.naxis > 0){ // multi-extension file is read by cfitsio
+			ok = FALSE;
+			break;
+		}else if(isimage && hdu.naxis > 0){ // the first non-empty image
+			found = TRUE;
+			img = hdu;
+			dataoff = pos + hlen;
+			if(hdu.naxis != 2 || !(dtype = equiv_type(&hdu))) ok = FALSE;
+		}else if(strcmp(hdu.xtension, "BINTABLE") == 0){
+			if(ntabs == MAX_TABLES) ok = FALSE;
+			else tabhdu[ntabs++] = hdunum;
+		}
+		pos += hlen + dlen;
+	}
+	if(!ok || !found){
+		list_free(&keys);
+		My_munmap(map);
+		DBG("file can't be read through mmap");
+		return NULL;
+	}
+	IMAGE *out = MALLOC(IMAGE, 1);
+	out->width = img.naxes[0];
+	out->height = img.naxes[1];
+	out->dtype = dtype;
+	out->keylist = keys;
+	DBG("got image %dx%d pix, bitpix=%d", out->width, out->height, dtype);
+	if(dtype == BYTE_IMG){ // data is used as is
+		out->pix = ptr + dataoff;
+		out->map = map;
+	}else{
+		lazysrc *src = MALLOC(lazysrc, 1);
+		src->map = map;
+		src->offset = dataoff;
+		src->bitpix = img.bitpix;
+		out->lazy = src;
+	}
+	if(ntabs){ // tables are read by cfitsio
+		fitsfile *fp;
+		int i, hdutype, fst = 0;
+		fits_open_file(&fp, filename, READONLY, &fst);
+		for(i = 0; i < ntabs && !fst; ++i){
+			if(fits_movabs_hdu(fp, tabhdu[i], &hdutype, &fst)) break;
+			table_read(out, fp);
+		}
+		if(fst) fits_report_error(stderr, fst);
+		fst = 0;
+		fits_close_file(fp, &fst);
+	}
+	return out;
+}
+
+/**
+ * convert pixels of image 'img' from mmap'ed file 'src' (at first access to them)
+ */
+void mmap_pixels(IMAGE *img, lazysrc *src){
+	size_t npix = img->width * img->height;
+#ifdef EBUG
+	double t0 = dtime();
+#endif
+	if(pix_datatype(img->dtype)) img->pix = MALLOC(uint8_t, npix * pix_size(img->dtype));
+	else img->data = MALLOC(Item, npix);
+	convert_pixels(src->map->data + src->offset, PIXPTR(img), npix, src->bitpix, img->dtype);
+	DBG("data converted, time=%gs", dtime() - t0);
+}
@@ -0,0 +1,80 @@
+/*
+ * group_kernels.h - group operations for different pixel types
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ *  HERE'S NO ANY "FILE-GUARDS" BECAUSE FILE IS MULTIPLY INCLUDED!
+ *  It is included from group_operations.c through pixtypes_inst.h
+ */
+
+/**
+ * add (sign > 0) or subtract (sign < 0) image 'in' from 'odata' (h x w)
+ */
+static void TFN(add_kernel)(double *odata, IMAGE *in, int h, int w, int sign){
+    int y, oriW = in->width;
+    PIXTYPE *idata = (PIXTYPE*)PIXPTR(in);
+    OMP_FOR(shared(idata, odata))
+    for(y = 0; y < h; ++y){
+        int x;
+        PIXTYPE *iptr = &idata[oriW*y];
+        double *optr = &odata[w*y];
+        if(sign > 0) for(x = 0; x < w; ++x)
+            *(optr++) += *(iptr++);
+        else for(x = 0; x < w; ++x)
+            *(optr++) -= *(iptr++);
+    }
+}
+
+/**
+ * copy image 'in' into 'odata' (h x w)
+ */
+static void TFN(copy_kernel)(double *odata, IMAGE *in, int h, int w){
+    int y, oriW = in->width;
+    PIXTYPE *idata = (PIXTYPE*)PIXPTR(in);
+    OMP_FOR(shared(idata, odata))
+    for(y = 0; y < h; ++y){
+        int x;
+        PIXTYPE *iptr = &idata[oriW*y];
+        double *optr = &odata[w*y];
+        for(x = 0; x < w; ++x)
+            *(optr++) = *(iptr++);
+    }
+}
+
+/**
+ * median by 'images_amount' images 'infiles' (all of the same type) into 'odata' (h x w)
+ */
+static void TFN(median_kernel)(PIXTYPE *odata, IMAGE **infiles, int images_amount, int h, int w){
+    int y;
+    PIXTYPE *idata = MALLOC(PIXTYPE, OMP_NUM_THREADS * images_amount);
+    OMP_FOR(shared(odata, idata))
+    for(y = 0; y < h; ++y){
+        int x, N;
+        PIXTYPE *optr = &odata[w*y];
+        PIXTYPE *inp = &idata[images_amount * omp_get_thread_num()];
+        for(x = 0; x < w; ++x){
+            for(N = 0; N < images_amount; ++N){
+                inp[N] = ((PIXTYPE*)PIXPTR(infiles[N]))[infiles[N]->width * y + x];
+            }
+            *(optr++) = TFN(median_inplace)(inp, images_amount);
+        }
+    }
+    FREE(idata);
+}
@@ -23,11 +23,21 @@
 #include "fits.h"
 #include "usefull_macros.h"
 #include "median.h"
+#include "pixtypes.h"
 #include <omp.h>
+#include "ioqueue.h"
+
+// amount of images read in advance while group operation is running
+#define GROUP_PREFETCH  (2)
 
 // files is NULL-terminated list - array of images
 typedef IMAGE * (*mathfuncptr)(IMAGE **files);
 
+// images are processed in their native data types
+#define TMPL_FILE "group_kernels.h"
+#include "pixtypes_inst.h"
+#undef TMPL_FILE
+
 /**
  * calculate minimal sizes in list of images
  */
@@ -46,29 +56,64 @@ static void get_minsizes(int *minh, int *minw, IMAGE **infiles){
     DBG("minimal sizes: %dx%d", wmin, hmin);
 }
 
+// reading of images data by separate thread while previous images are processed
+typedef struct{
+    IMAGE **files;      // NULL-terminated list of images
+    ioqueue *q;         // images with data read
+    pthread_t thread;
+} prefetcher;
+
+static void *prefetch_thread(void *arg){
+    prefetcher *p = (prefetcher*) arg;
+    for(IMAGE **f = p->files; *f; ++f){
+        image_load(*f);
+        if(!ioq_push(p->q, *f)) break;
+    }
+    ioq_close(p->q);
+    return NULL;
+}
+
+static void prefetch_start(prefetcher *p, IMAGE **files){
+    p->files = files;
+    p->q = ioq_new(GROUP_PREFETCH);
+    if(pthread_create(&p->thread, NULL, prefetch_thread, p)) ERR(_("Can't create I/O thread"));
+}
+
+/**
+ * get next image with data (data of previous image is freed, so caller shouldn't use it)
+ * @return image or NULL at the end of list
+ */
+static IMAGE *prefetch_next(prefetcher *p, IMAGE *prev){
+    if(prev) image_drop(prev);
+    return (IMAGE*) ioq_pop(p->q);
+}
+
+static void prefetch_stop(prefetcher *p){
+    ioq_close(p->q);
+    pthread_join(p->thread, NULL);
+    ioq_free(&p->q);
+}
+
 /**
  * Calculate sum of images in list
+ * images are read by separate thread, so reading of next image overlaps with adding of current one
  */
 static IMAGE* math_sum(IMAGE **infiles){
     FNAME();
     if(!infiles || !*infiles) return NULL;
     int h, w;
     get_minsizes(&h, &w, infiles);
-    IMAGE *outp = newFITS(h, w, DOUBLE_IMG);
+    IMAGE *outp = newFITS(h, w, DOUBLE_IMG), *in = NULL;
     double *odata = outp->data;
-    while(*infiles){
-        IMAGE *in = *infiles;
-        int y, oriW = in->width;
-        DBG("process file with W=%d", oriW);
-        OMP_FOR(shared(in, odata))
-        for(y = 0; y < h; ++y){
-            int x;
-            double *iptr = &in->data[oriW*y], *optr = &odata[w*y];
-            for(x = 0; x < w; ++x)
-                *(optr++) += *(iptr++);
-        }
-        ++infiles;
+    prefetcher p;
+    prefetch_start(&p, infiles);
+    while((in = prefetch_next(&p, in))){
+        DBG("process file with W=%d", in->width);
+        #define ADD(type, sfx) add_kernel ## sfx(odata, in, h, w, 1)
+        PIX_DISPATCH(in, ADD);
+        #undef ADD
     }
+    prefetch_stop(&p);
     DBG("OK");
     return outp;
 }
@@ -79,38 +124,33 @@ static IMAGE* math_sum(IMAGE **infiles){
 static IMAGE* math_diff(IMAGE **infiles){
     FNAME();
     if(!infiles || !*infiles) return NULL;
-    int h, w, y, oriW;
+    int h, w;
     get_minsizes(&h, &w, infiles);
     if((*infiles)->height != h || (*infiles)->width != w){
         ///     ,     
         ERRX(_("Files should have equal sizes or first file should be least"));
     }
     IMAGE *outp = newFITS(h, w, DOUBLE_IMG);
-    // copy data from first file (type should be double!)
+    // copy data from first file
     IMAGE *in = *infiles;
-    oriW = in->width;
     double *odata = outp->data;
-    OMP_FOR(shared(in, odata))
-    for(y = 0; y < h; ++y){
-        double *iptr = &in->data[oriW*y], *optr = &odata[w*y];
-        memcpy(optr, iptr, w*sizeof(double));
-    }
+    #define COPY(type, sfx) copy_kernel ## sfx(odata, in, h, w)
+    PIX_DISPATCH(in, COPY);
+    #undef COPY
+    image_drop(in);
     ++infiles;
     ///      
     if(!*infiles) ERRX(_("Point at least two files"));
-    while(*infiles){
-        in = *infiles;
-        oriW = in->width;
-        DBG("process file with W=%d", oriW);
-        OMP_FOR(shared(in, odata))
-        for(y = 0; y < h; ++y){
-            int x;
-            double *iptr = &in->data[oriW*y], *optr = &odata[w*y];
-            for(x = 0; x < w; ++x)
-                *(optr++) -= *(iptr++);
-        }
-        ++infiles;
+    prefetcher p;
+    prefetch_start(&p, infiles);
+    in = NULL;
+    while((in = prefetch_next(&p, in))){
+        DBG("process file with W=%d", in->width);
+        #define SUB(type, sfx) add_kernel ## sfx(odata, in, h, w, -1)
+        PIX_DISPATCH(in, SUB);
+        #undef SUB
     }
+    prefetch_stop(&p);
     DBG("OK");
     return outp;
 }
@@ -143,24 +183,23 @@ static IMAGE* math_median(IMAGE **infiles){
         ///         
         ERRX(_("Can't calculate median for less than two images"));
     }
-    int h, w, y;
+    int h, w;
     get_minsizes(&h, &w, infiles);
-    IMAGE *out = newFITS(h, w, DOUBLE_IMG);
-    double *odata = out->data;
-    double *idata = MALLOC(double, OMP_NUM_THREADS * images_amount);
-    OMP_FOR(shared(odata, idata))
-    for(y = 0; y < h; ++y){
-        int x, N;
-        double *optr = &odata[w*y];
-        double *inp = &idata[images_amount * omp_get_thread_num()];
-        for(x = 0; x < w; ++x){
-            for(N = 0; N < images_amount; ++N){
-                inp[N] = infiles[N]->data[infiles[N]->width * y + x];
-            }
-            *(optr++) = calc_median(inp, images_amount);
-        }
+    // median is calculated in native type only if all images have the same type
+    int dtype = (*infiles)->dtype;
+    bool native = TRUE;
+    for(f = infiles; *f; ++f){
+        image_load(*f);
+        if(!(*f)->pix || (*f)->dtype != dtype) native = FALSE;
+    }
+    if(!native){
+        for(f = infiles; *f; ++f) image_data(*f);
+        dtype = DOUBLE_IMG;
     }
-    FREE(idata);
+    IMAGE *out = nativeFITS(h, w, dtype);
+    #define MEDIAN(type, sfx) median_kernel ## sfx((type*)PIXPTR(out), infiles, images_amount, h, w)
+    PIX_DISPATCH(out, MEDIAN);
+    #undef MEDIAN
     return out;
 }
 
@@ -200,7 +239,7 @@ IMAGE *make_group_operation(int names_amount, char **names, MathOper oper){
     IMAGE **filelist = MALLOC(IMAGE*, names_amount + 1); // +1 for terminated NULL
     int i, ctr = 0;
     for(i = 0; i < names_amount; ++i){
-        if(!readFITS(names[i], &filelist[i])){
+        if(!readFITS(names[i], &filelist[ctr])){
             ///     %s  
             WARNX(_("Can't read file %s from sequence"), names[i]);
         }else{
@@ -214,7 +253,11 @@ IMAGE *make_group_operation(int names_amount, char **names, MathOper oper){
         ERRX(_("The amount of available files less than two"));
     }
     IMAGE *ret = anoper(filelist);
-    if(ret) ret->keylist = list;
+    if(ret){
+        ret->keylist = list;
+        // by default result would be saved in data type of input files
+        if(!ret->pix) ret->dtype = filelist[0]->dtype;
+    }
     // free filelist
     for(i = 0; i < ctr; ++i) imfree(&filelist[i]);
     FREE(filelist);
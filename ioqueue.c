@@ -0,0 +1,95 @@
+/*
+ * ioqueue.c - bounded queue for overlapping of reading, processing & writing
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include "ioqueue.h"
+#include "usefull_macros.h"
+
+/**
+ * create queue for 'size' items (push blocks while queue is full)
+ */
+ioqueue *ioq_new(int size){
+	ioqueue *q = MALLOC(ioqueue, 1);
+	if(size < 1) size = 1;
+	q->items = MALLOC(void*, size);
+	q->size = size;
+	pthread_mutex_init(&q->mutex, NULL);
+	pthread_cond_init(&q->notempty, NULL);
+	pthread_cond_init(&q->notfull, NULL);
+	return q;
+}
+
+void ioq_free(ioqueue **q){
+	if(!q || !*q) return;
+	pthread_mutex_destroy(&(*q)->mutex);
+	pthread_cond_destroy(&(*q)->notempty);
+	pthread_cond_destroy(&(*q)->notfull);
+	FREE((*q)->items);
+	FREE(*q);
+}
+
+/**
+ * add item to the end of queue (wait while queue is full)
+ * @return FALSE if queue is closed
+ */
+bool ioq_push(ioqueue *q, void *item){
+	bool ret = false;
+	pthread_mutex_lock(&q->mutex);
+	while(q->count == q->size && !q->closed)
+		pthread_cond_wait(&q->notfull, &q->mutex);
+	if(!q->closed){
+		q->items[(q->head + q->count) % q->size] = item;
+		++q->count;
+		ret = true;
+		pthread_cond_signal(&q->notempty);
+	}
+	pthread_mutex_unlock(&q->mutex);
+	return ret;
+}
+
+/**
+ * get first item of queue (wait while queue is empty)
+ * @return item or NULL if queue is closed & empty
+ */
+void *ioq_pop(ioqueue *q){
+	void *item = NULL;
+	pthread_mutex_lock(&q->mutex);
+	while(q->count == 0 && !q->closed)
+		pthread_cond_wait(&q->notempty, &q->mutex);
+	if(q->count){
+		item = q->items[q->head];
+		q->head = (q->head + 1) % q->size;
+		--q->count;
+		pthread_cond_signal(&q->notfull);
+	}
+	pthread_mutex_unlock(&q->mutex);
+	return item;
+}
+
+/**
+ * mark queue as closed: rest of items could be popped, push is impossible
+ */
+void ioq_close(ioqueue *q){
+	pthread_mutex_lock(&q->mutex);
+	q->closed = true;
+	pthread_cond_broadcast(&q->notempty);
+	pthread_cond_broadcast(&q->notfull);
+	pthread_mutex_unlock(&q->mutex);
+}
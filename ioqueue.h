@@ -0,0 +1,46 @@
+/*
+ * ioqueue.h
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __IOQUEUE_H__
+#define __IOQUEUE_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// bounded blocking queue of pointers between I/O threads & computing thread
+typedef struct{
+	void **items;			// ring buffer
+	int size;				// capacity
+	int head;				// index of first item
+	int count;				// amount of items in queue
+	bool closed;			// no more items would be pushed
+	pthread_mutex_t mutex;
+	pthread_cond_t notempty;
+	pthread_cond_t notfull;
+} ioqueue;
+
+ioqueue *ioq_new(int size);
+void ioq_free(ioqueue **q);
+bool ioq_push(ioqueue *q, void *item);
+void *ioq_pop(ioqueue *q);
+void ioq_close(ioqueue *q);
+
+#endif // __IOQUEUE_H__
@@ -23,6 +23,7 @@
 #include "usefull_macros.h"
 #include "linfilter.h"
 #include "median.h"
+#include "pixtypes.h"
 
 stepscalespairs scales[] = {
 	{UNIFORM, "uniform"},
@@ -33,6 +34,10 @@ stepscalespairs scales[] = {
 	{0, NULL}
 };
 
+// statistics, step, cut & binarization for all pixel types
+#define TMPL_FILE "linfilter_kernels.h"
+#include "pixtypes_inst.h"
+#undef TMPL_FILE
 
 /**
  * calculate simple statistics by image
@@ -44,17 +49,10 @@ void get_statictics(IMAGE *img, Item *min, Item *max,
 	if(!img) return;
 	size_t sz = img->width * img->height;
 	if(min || max || mean || std){
-		Item *idata = img->data;
-		Item minval = *idata, maxval = minval, sum = minval, sum2 = minval*minval;
-		size_t i;
-		++idata;
-		for(i = 1; i < sz; ++i, ++idata){
-			Item val = *idata;
-			if(val > maxval) maxval = val;
-			else if(val < minval) minval = val;
-			sum += val;
-			sum2 += val*val;
-		}
+		Item minval, maxval, sum, sum2;
+		#define STAT(type, sfx) stat_kernel ## sfx((type*)PIXPTR(img), sz, &minval, &maxval, &sum, &sum2)
+		PIX_DISPATCH(img, STAT);
+		#undef STAT
 		if(min){
 			*min = minval;
 			DBG("minimum: %g", minval);
@@ -74,7 +72,9 @@ void get_statictics(IMAGE *img, Item *min, Item *max,
 		}
 	}
 	if(med){
-		*med = quick_select(img->data, sz);
+		#define MED(type, sfx) *med = quick_select ## sfx((type*)PIXPTR(img), sz)
+		PIX_DISPATCH(img, MED);
+		#undef MED
 		DBG("median: %g", *med);
 	}
 }
@@ -142,8 +142,9 @@ void fillIsoScale(Filter *f, Itmarray *scale, Item min, Item wd){
  * Output:
  *		result - filtered image, the memory is allocated in this procedure
  *		scale - the scale of intensities, the memory is allocated here (if the scale!=NULL)
+ * Result is uint8_t image (BYTE_IMG)
  *
- * TODO: save the result in the char, not float; learn display function
+ * TODO: learn display function
  */
 IMAGE *StepFilter(IMAGE *img, Filter *f, Itmarray *scale){
 	if(f->w < 2 || f->w > 255){
@@ -152,8 +153,9 @@ IMAGE *StepFilter(IMAGE *img, Filter *f, Itmarray *scale){
 		return NULL;
 	}
 	Item Nsteps = (Item)f->w; // amount of intervals
-	Item step, max, min;
-	get_statictics(img, &min, &max, NULL, NULL, NULL);
+	Item step, max = f->max, min = f->min;
+	if(max <= min) // data range is unknown
+		get_statictics(img, &min, &max, NULL, NULL, NULL);
 	Item wd = max - min;
 	if(fabs(wd) < ITM_EPSILON) return FALSE;
 	Item (*stepfn)(Item in);
@@ -207,16 +209,11 @@ IMAGE *StepFilter(IMAGE *img, Filter *f, Itmarray *scale){
 	//		f->w, scales[f->h].name);
 	//	list_add_record(&img->keylist, buf);
 	}
-	IMAGE *out = similarFITS(img, BYTE_IMG);
-	Item *res = out->data, *inputima = img->data;
 	size_t sizex = img->width, sizey = img->height;
-	OMP_FOR(shared(res, inputima))
-	for(size_t y = 0; y < sizey; ++y){
-		Item *iout = &res[y*sizex], *iin = &inputima[y*sizex];
-		for(size_t x = 0; x < sizex; ++x, ++iin, ++iout){
-			*iout = stepfn(*iin);
-		}
-	}
+	IMAGE *out = nativeFITS(sizey, sizex, BYTE_IMG);
+	#define STEP(type, sfx) step_kernel ## sfx((type*)PIXPTR(img), (uint8_t*)out->pix, sizex, sizey, stepfn)
+	PIX_DISPATCH(img, STEP);
+	#undef STEP
 	if(scale)
 		fillIsoScale(f, scale, min, wd);
 	DBG("SF: %d sublevels, step=%g, time=%f\n", f->w, step, dtime()-t0);
@@ -228,23 +225,21 @@ IMAGE *StepFilter(IMAGE *img, Filter *f, Itmarray *scale){
  */
 void cut_bounds(IMAGE *img, Item low, Item up){
 	if(!(low < DBL_MAX - 1. || up < DBL_MAX - 1.)) return;
-	Item min, max;
 	bool lowct = FALSE, upct = FALSE;
-	get_statictics(img, &min, &max, NULL, NULL, NULL);
 	if(low < DBL_MAX - 1.)
 		lowct = TRUE;
 	if(up < DBL_MAX - 1.)
 		upct = TRUE;
-	int w = img->width, h = img->height, y;
-	OMP_FOR(shared(img))
-	for(y = 0; y < h; ++y){
-		Item *data = &img->data[y * w];
-		int x;
-		for(x = 0; x < w; ++x, ++data){
-			if(lowct && *data < low) *data = low;
-			else if(upct && *data > up) *data = up;
-		}
-	}
+	int w = img->width, h = img->height;
+	image_load(img);
+	// fractional bounds can't be stored in integer data
+	if(img->pix && img->dtype != FLOAT_IMG &&
+		((lowct && low != floor(low)) || (upct && up != floor(up))))
+		image_data(img);
+	#define CUT(type, sfx) cut_kernel ## sfx((type*)PIXPTR(img), w, h, low, up, lowct, upct)
+	PIX_DISPATCH(img, CUT);
+	#undef CUT
+	image_changed(img);
 	char buf[80];
 	if(lowct && !upct)
 		snprintf(buf, 80, "COMMENT cut lower bound to value %g", (double)low);
@@ -266,6 +261,16 @@ void cut_bounds(IMAGE *img, Item low, Item up){
  * @param thrvalue (o) - threshold intensity level
  */
 uint16_t *binarize(IMAGE *img, double threshold, Item *thrvalue){
+	Item min, max;
+	get_statictics(img, &min, &max, NULL, NULL, NULL);
+	return binarize_range(img, threshold, min, max, thrvalue);
+}
+
+/**
+ * Convert image to binary by threshold in data range [min, max]
+ * (the same as binarize() but when data range is known, e.g. for image strips)
+ */
+uint16_t *binarize_range(IMAGE *img, double threshold, Item min, Item max, Item *thrvalue){
 	DBG("THRES: %g", threshold);
 	if(threshold < -1. + DBL_EPSILON || threshold > 1. - DBL_EPSILON){
 		///       (-1, 1)
@@ -277,28 +282,28 @@ uint16_t *binarize(IMAGE *img, double threshold, Item *thrvalue){
 		threshold = -threshold;
 		invert = TRUE;
 	}
-	Item min, max;
-	get_statictics(img, &min, &max, NULL, NULL, NULL);
 	Item thrval = min + (max - min) * threshold;
-	int w = img->width, h = img->height, y;
+	int w = img->width, h = img->height;
 	uint16_t *ret = MALLOC(uint16_t, w*h);
-	OMP_FOR(shared(img))
-	for(y = 0; y < h; ++y){
-		Item *idata = &img->data[y * w];
-		uint16_t *odata = &ret[y * w];
-		int x;
-		for(x = 0; x < w; ++x, ++idata, ++odata){
-			if(*idata < thrval) *odata = invert;
-			else *odata = !invert;
-		}
-	}
+	#define BINARIZE(type, sfx) binarize_kernel ## sfx((type*)PIXPTR(img), ret, w, h, thrval, invert)
+	PIX_DISPATCH(img, BINARIZE);
+	#undef BINARIZE
 	if(thrvalue) *thrvalue = thrval;
 	return ret;
 }
 
 IMAGE *get_binary(IMAGE *img, double threshold){
+	Item min, max;
+	get_statictics(img, &min, &max, NULL, NULL, NULL);
+	return get_binary_range(img, threshold, min, max);
+}
+
+/**
+ * binary image by threshold in known data range [min, max]
+ */
+IMAGE *get_binary_range(IMAGE *img, double threshold, Item min, Item max){
 	Item thrval;
-	uint16_t *binary = binarize(img, threshold, &thrval);
+	uint16_t *binary = binarize_range(img, threshold, min, max, &thrval);
 	if(!binary) return NULL;
 	IMAGE *ret = buildFITSfromdat(img->height, img->width, SHORT_IMG, (uint8_t*)binary);
 	FREE(binary);
@@ -46,9 +46,12 @@ extern stepscalespairs scales[];
 void get_statictics(IMAGE *img, Item *min, Item *max,
 					Item *mean, Item *std, Item *med);
 IMAGE *StepFilter(IMAGE *img, Filter *f, Itmarray *scale);
+void fillIsoScale(Filter *f, Itmarray *scale, Item min, Item wd);
 
 void cut_bounds(IMAGE *img, Item low, Item up);
 uint16_t *binarize(IMAGE *img, double threshold, Item *thrval);
+uint16_t *binarize_range(IMAGE *img, double threshold, Item min, Item max, Item *thrvalue);
 IMAGE *get_binary(IMAGE *img, double thres);
+IMAGE *get_binary_range(IMAGE *img, double threshold, Item min, Item max);
 
 #endif // __LINFILTER_H__
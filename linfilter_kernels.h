@@ -0,0 +1,95 @@
+/*
+ * linfilter_kernels.h - pixel operations of linfilter.c for different pixel types
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ *  HERE'S NO ANY "FILE-GUARDS" BECAUSE FILE IS MULTIPLY INCLUDED!
+ *  It is included from linfilter.c through pixtypes_inst.h
+ */
+
+/**
+ * min, max, sum & sum of squares of array idata with size sz
+ */
+static void TFN(stat_kernel)(PIXTYPE *idata, size_t sz, Item *min, Item *max,
+							Item *sum, Item *sum2){
+	Item minval = *idata, maxval = minval, s = 0., s2 = 0.;
+	OMP_FOR(reduction(min:minval) reduction(max:maxval) reduction(+:s,s2))
+	for(size_t i = 0; i < sz; ++i){
+		Item val = idata[i];
+		if(val > maxval) maxval = val;
+		if(val < minval) minval = val;
+		s += val;
+		s2 += val*val;
+	}
+	*min = minval; *max = maxval;
+	*sum = s; *sum2 = s2;
+}
+
+/**
+ * "posterization" of image 'inputima' by step function 'stepfn'
+ * output levels are in [0, 255]
+ */
+static void TFN(step_kernel)(PIXTYPE *inputima, uint8_t *res, size_t sizex, size_t sizey,
+							Item (*stepfn)(Item in)){
+	OMP_FOR(shared(res, inputima))
+	for(size_t y = 0; y < sizey; ++y){
+		uint8_t *iout = &res[y*sizex];
+		PIXTYPE *iin = &inputima[y*sizex];
+		for(size_t x = 0; x < sizex; ++x, ++iin, ++iout){
+			Item lvl = stepfn(*iin);
+			if(lvl < 0.) *iout = 0;
+			else if(lvl > 255.) *iout = 255;
+			else *iout = (uint8_t)lvl;
+		}
+	}
+}
+
+/**
+ * set all values more than 'up' to 'up & less than 'low' to 'low'
+ */
+static void TFN(cut_kernel)(PIXTYPE *idata, int w, int h, Item low, Item up, bool lowct, bool upct){
+	int y;
+	OMP_FOR(shared(idata))
+	for(y = 0; y < h; ++y){
+		PIXTYPE *data = &idata[y * w];
+		int x;
+		for(x = 0; x < w; ++x, ++data){
+			if(lowct && *data < low) *data = (PIXTYPE)low;
+			else if(upct && *data > up) *data = (PIXTYPE)up;
+		}
+	}
+}
+
+/**
+ * binarize image 'img' by threshold intensity 'thrval'
+ */
+static void TFN(binarize_kernel)(PIXTYPE *img, uint16_t *ret, int w, int h, Item thrval, bool invert){
+	int y;
+	OMP_FOR(shared(img))
+	for(y = 0; y < h; ++y){
+		PIXTYPE *idata = &img[y * w];
+		uint16_t *odata = &ret[y * w];
+		int x;
+		for(x = 0; x < w; ++x, ++idata, ++odata){
+			if(*idata < thrval) *odata = invert;
+			else *odata = !invert;
+		}
+	}
+}
@@ -20,25 +20,48 @@
  */
 
 #include <stdio.h>
+#include <glob.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#ifdef OMP_FOUND
+#include <omp.h>
+#endif
 #include "usefull_macros.h"
 #include "fits.h"
 #include "median.h"
+#include "pixtypes.h"
+#include "fitscomp.h"
 #include "convfilter.h"
 #include "linfilter.h"
 #include "cmdlnopts.h"
 #include "pipeline.h"
 #include "group_operations.h"
 #include "binmorph.h"
+#include "ioqueue.h"
+#include "shmring.h"
 
 #ifndef BUFF_SIZ
 #define BUFF_SIZ 4096
 #endif
+// max amount of data cube planes processed at once
+#define CUBE_PORTION (2 * THREAD_NUMBER)
+// batch mode: size of image (pixels) per one thread
+#define BATCH_PIX_PER_THREAD (1<<20)
+// batch mode: max amount of images waiting for processing or for writing
+#define BATCH_QUEUE_SIZE (1)
+// daemon mode: max amount of pipeline stages in job & max amount of pending connections
+#define DAEMON_MAX_STAGES (64)
+#define DAEMON_BACKLOG (16)
 
 void signals(int signo){
     exit(signo);
 }
 
-#define swap_el(a, b)  {register Item t = a; a = b; b = t;}
+#define swap_el(type, a, b)  {register type t = a; a = b; b = t;}
 /**
  * flip an image by X-axis (top <-> bottom)
  */
@@ -48,13 +71,19 @@ void flip_X(IMAGE *f){
         return;
     }
     int w = f->width, h = f->height, h2 = h/2;
-    OMP_FOR()
-    for(int _col = 0; _col < w; ++_col){
-        Item *pixa = &f->data[_col], *pixb = pixa + w*(h-1); // first & last pixels in column
-        for(int _row = 0; _row < h2; ++_row, pixa += w, pixb -= w){
-            swap_el(*pixa, *pixb);
-        }
-    }
+    #define FLIPX(type, sfx) do{                                            \
+        type *data = (type*)PIXPTR(f);                                      \
+        OMP_FOR()                                                           \
+        for(int _col = 0; _col < w; ++_col){                                \
+            type *pixa = &data[_col], *pixb = pixa + w*(h-1); /* first & last pixels in column */ \
+            for(int _row = 0; _row < h2; ++_row, pixa += w, pixb -= w){     \
+                swap_el(type, *pixa, *pixb);                                \
+            }                                                               \
+        }                                                                   \
+    }while(0)
+    PIX_DISPATCH(f, FLIPX);
+    #undef FLIPX
+    image_changed(f);
 }
 /**
  * flip an image by Y-axis (left <-> right)
@@ -65,27 +94,895 @@ void flip_Y(IMAGE *f){
         return;
     }
     int w = f->width, h = f->height, w2 = w/2;
-    OMP_FOR()
-    for(int _row = 0; _row < h; ++_row){
-        Item *pixa = &f->data[_row*w], *pixb = pixa + w - 1; // first & last pixels in row
-        for(int _col= 0; _col < w2; ++_col, ++pixa, --pixb){
-            swap_el(*pixa, *pixb);
+    #define FLIPY(type, sfx) do{                                            \
+        type *data = (type*)PIXPTR(f);                                      \
+        OMP_FOR()                                                           \
+        for(int _row = 0; _row < h; ++_row){                                \
+            type *pixa = &data[_row*w], *pixb = pixa + w - 1; /* first & last pixels in row */ \
+            for(int _col= 0; _col < w2; ++_col, ++pixa, --pixb){            \
+                swap_el(type, *pixa, *pixb);                                \
+            }                                                               \
+        }                                                                   \
+    }while(0)
+    PIX_DISPATCH(f, FLIPY);
+    #undef FLIPY
+    image_changed(f);
+}
+
+
+
+/**
+ * change keys in output file FITS-header by command line parameters
+ */
+static void edit_header(KeyList **keylist){
+    char **p;
+    if(keys2delete){
+        DBG("delete keys");
+        for(p = keys2delete; *p; ++p)
+            list_remove_key(keylist, *p);
+    }
+    if(recs2delete){
+        DBG("delete records");
+        for(p = recs2delete; *p; ++p)
+            list_remove_records(keylist, *p);
+    }
+    if(recs2add){
+        DBG("add records");
+        for(p = recs2add; *p; ++p)
+            list_add_record(keylist, *p);
+    }
+}
+
+/**
+ * check whether only header of input file is changed in place (so data shouldn't be rewritten)
+ */
+static bool header_only(bool pipe_need, int otype){
+    if(!inplace || !G.infile || pipe_need || otype || show_stat || G.listabs || G.flip || G.zcomp || G.deltabs)
+        return FALSE;
+    if(G.low_bound < DBL_MAX - 1. || G.up_bound < DBL_MAX - 1. || G.binarize < DBL_MAX - 1.
+        || G.conncomp4 < DBL_MAX - 1. || G.conncomp8 < DBL_MAX - 1.)
+        return FALSE;
+    return TRUE;
+}
+
+/**
+ * process input image by strips (pipeline, cuts & binarization)
+ * @param pipe_need - TRUE if there's pipeline
+ * @param otype     - output data type or 0 for type of result
+ * @return FALSE if image can't be processed by strips
+ */
+static bool process_by_strips(bool pipe_need, int otype){
+    FNAME();
+    if(show_stat || G.listabs || G.flip || G.zcomp || G.conncomp4 < DBL_MAX - 1. || G.conncomp8 < DBL_MAX - 1.){
+        WARNX(_("Given operations can't be done by strips"));
+        return FALSE;
+    }
+    int halo = pipe_need ? pipeline_halo() : 0, top, nrows;
+    if(halo < 0){
+        WARNX(_("Pipeline can't be processed by strips"));
+        return FALSE;
+    }
+    FITSstream *in = stream_open(G.infile, G.striph, halo), *out = NULL;
+    if(!in) ERRX(_("Can't read input file!"));
+    if(in->hdr->next){
+        WARNX(_("Multi-extension files can't be processed by strips"));
+        stream_close(&in);
+        return FALSE;
+    }
+    if(pipe_need && !pipeline_prepare_strips(in)) ERRX(_("Can't prepare pipeline"));
+    Item min = 0., max = 0.;
+    bool binar = (G.binarize < DBL_MAX - 1.);
+    if(binar){ // we need data range of image after pipeline & cuts
+        if(!pipeline_range(in, pipe_need ? (size_t)-1 : 0, &min, &max))
+            ERRX(_("Can't get data range"));
+        if(G.low_bound < DBL_MAX - 1.){
+            if(min < G.low_bound) min = G.low_bound;
+            if(max < G.low_bound) max = G.low_bound;
+        }
+        if(G.up_bound < DBL_MAX - 1.){
+            if(max > G.up_bound) max = G.up_bound;
+            if(min > G.up_bound) min = G.up_bound;
         }
     }
+    in->halo = halo;
+    IMAGE *strip;
+    bool first = TRUE;
+    while((strip = stream_read_strip(in, &top, &nrows))){
+        IMAGE *res = pipe_need ? process_pipeline_strip(strip, first) : strip;
+        cut_bounds(res, G.low_bound, G.up_bound);
+        if(binar){
+            IMAGE *tmp = get_binary_range(res, G.binarize, min, max);
+            imfree(&res);
+            res = tmp;
+        }
+        if(first){ // now we know output type & additional header records
+            IMAGE *hdr = MALLOC(IMAGE, 1);
+            hdr->width = res->width;
+            hdr->height = in->hdr->height;
+            hdr->dtype = otype ? otype : res->dtype;
+            hdr->keylist = list_copy(in->hdr->keylist);
+            int r = 0;
+            char *rec;
+            while((rec = list_next(res->keylist, &r))) list_add_record(&hdr->keylist, rec);
+            hdr->tables = in->hdr->tables; // move tables to output
+            in->hdr->tables = NULL;
+            if(res->tables){
+                size_t i, N = res->tables->amount;
+                for(i = 0; i < N; ++i){
+                    FITStable *t = res->tables->tables[i], *o = table_new(hdr, t->tabname);
+                    for(int c = 0; c < t->ncols; ++c) table_addcolumn(o, &t->columns[c]);
+                }
+            }
+            edit_header(&hdr->keylist);
+            if(!(out = stream_create(G.outfile, hdr))) ERRX(_("Can't create output file"));
+            first = FALSE;
+        }
+        if(!stream_write_strip(out, res, top, nrows)) ERRX(_("Can't write strip"));
+        imfree(&res);
+    }
+    stream_close(&in);
+    if(!out || !stream_close(&out)) ERRX(_("Can't save output file"));
+    return TRUE;
 }
 
+/**
+ * process image (single image or one extension of multi-extension file):
+ * pipeline, cuts, binarization or labeling, header editing, flipping & output type
+ * @param fits      - input image (always freed here, result is a new image or 'fits' itself)
+ * @param pipe_need - TRUE if there's pipeline
+ * @param otype     - output data type or 0
+ * @return processed image or NULL
+ */
+static IMAGE *process_image(IMAGE *fits, bool pipe_need, int otype){
+    IMAGE *newfit = NULL;
+    int itype = fits->dtype;
+    // process pipeline both in case of single input file ('-i')
+    if(pipe_need && (newfit = process_pipeline(fits))){
+        // pipeline works with copy of input: its header of empty primary HDU goes to result
+        newfit->primary = fits->primary;
+        fits->primary = NULL;
+        imfree(&fits);
+    }
 
+    if(show_stat && newfit){
+        Item min, max, mean, std, med;
+        get_statictics(newfit, &min, &max, &mean, &std, &med);
+        #pragma omp critical (stat_output)
+        {
+            // "    :\n"
+            green(_("Image statistics after pipeline:\n"));
+            printf("min = %g, max = %g, mean = %g, std = %g, median = %g\n",
+                    min, max, mean, std, med);
+        }
+    }
+    if(!newfit) newfit = fits;
+    // process cuts & so on
+    cut_bounds(newfit, G.low_bound, G.up_bound);
+    if(!newfit) signals(-1);
+    // here are operations that can't be done together
+    if(G.binarize < DBL_MAX - 1.){
+        IMAGE *tmp = get_binary(newfit, G.binarize);
+        imfree(&newfit);
+        newfit = tmp;
+    }else if(G.conncomp4 < DBL_MAX - 1.){
+        size_t n;
+        IMAGE *tmp = cclabel4(newfit, G.conncomp4, &n);
+        imfree(&newfit);
+        newfit = tmp;
+        green("Found %d 4-connected regions\n", n);
+    }else if(G.conncomp8 < DBL_MAX - 1.){
+        size_t n;
+        IMAGE *tmp = cclabel8(newfit, G.conncomp8, &n);
+        imfree(&newfit);
+        newfit = tmp;
+        green("Found %d 8-connected regions\n", n);
+    }
+    if(!newfit) return NULL;
+    /**************************************************************************************************************
+     *
+     * place here any other operations with [processed through pipeline] input file or result of group operations
+     *    (newfit)
+     *
+     **************************************************************************************************************/
+    // change keys in output file FITS-header
+    edit_header(&newfit->keylist);
+
+    // process flipping
+    if(G.flip){
+        char *flip = G.flip;
+        if(strchr(flip, 'x') || strchr(flip, 'X')) flip_X(newfit);
+        if(strchr(flip, 'y') || strchr(flip, 'Y')) flip_Y(newfit);
+    }
+    // output data type: given by user or type of input for floating point results
+    if(otype) set_dtype(newfit, otype);
+    else if(!newfit->pix && itype) newfit->dtype = itype;
+    return newfit;
+}
+
+/**
+ * process all images of multi-extension file in parallel
+ * @return chain of processed images (with header of primary HDU) or NULL
+ */
+static IMAGE *process_extensions(IMAGE *fits, bool pipe_need, int otype){
+    int i, n = 0;
+    IMAGE *cur, **ext, *out = NULL;
+    KeyList *primary = fits->primary;
+    fits->primary = NULL;
+    for(cur = fits; cur; cur = cur->next) ++n;
+    ext = MALLOC(IMAGE*, n);
+    for(i = 0, cur = fits; cur; ++i){ // detach images from chain
+        ext[i] = cur;
+        cur = cur->next;
+        ext[i]->next = NULL;
+    }
+    DBG("process %d extensions", n);
+    OMP_FOR(schedule(dynamic))
+    for(i = 0; i < n; ++i)
+        ext[i] = process_image(ext[i], pipe_need, otype);
+    for(i = n - 1; i >= 0; --i){
+        if(!ext[i]) continue;
+        ext[i]->next = out;
+        out = ext[i];
+    }
+    if(out) out->primary = primary;
+    else list_free(&primary);
+    FREE(ext);
+    return out;
+}
+
+/**
+ * process data cube plane by plane: planes are read & written sequentially,
+ * portions of CUBE_PORTION planes are processed in parallel
+ * (so the whole cube is never loaded into memory)
+ * @param in        - cube opened by cube_open (would be closed here)
+ * @param outfile   - output file name
+ * @param pipe_need - TRUE if there's pipeline
+ * @param otype     - output data type or 0
+ */
+static void process_cube(FITSstream *in, char *outfile, bool pipe_need, int otype){
+    FNAME();
+    long p0, nplanes = in->nplanes;
+    int i, n;
+    IMAGE *planes[CUBE_PORTION];
+    FITSstream *out = NULL;
+    if(show_stat || G.listabs || G.zcomp){
+        WARNX(_("Statistics, tables listing & compression aren't available for data cubes"));
+        show_stat = 0;
+    }
+    for(p0 = 0; p0 < nplanes; p0 += n){
+        n = (int)MIN(CUBE_PORTION, nplanes - p0);
+        for(i = 0; i < n; ++i)
+            if(!(planes[i] = cube_read_plane(in))) ERRX(_("Can't read plane %ld"), p0 + i);
+        if(!out){ // first plane carries headers & tables of cube
+            planes[0]->keylist = in->hdr->keylist;
+            planes[0]->tables = in->hdr->tables;
+            in->hdr->keylist = NULL;
+            in->hdr->tables = NULL;
+        }
+        // input planes are freed by process_image (with headers & tables of cube if pipeline
+        // made a new image of the first plane), so only CUBE_PORTION planes are kept in memory
+        OMP_FOR(schedule(dynamic))
+        for(i = 0; i < n; ++i)
+            if(!(planes[i] = process_image(planes[i], pipe_need, otype)))
+                ERRX(_("Can't process plane %ld"), p0 + i);
+        if(!out){ // now we know output type & header
+            IMAGE *hdr = MALLOC(IMAGE, 1);
+            hdr->width = planes[0]->width;
+            hdr->height = planes[0]->height;
+            // processed planes are stored as floating point unless output type is given
+            // (integer output type would be quantized with common BSCALE/BZERO by cube_write_plane)
+            hdr->dtype = (otype || planes[0]->pix || planes[0]->dtype < 0) ? planes[0]->dtype : DOUBLE_IMG;
+            hdr->keylist = planes[0]->keylist;
+            hdr->tables = planes[0]->tables;
+            planes[0]->keylist = NULL;
+            planes[0]->tables = NULL;
+            if(!(out = cube_create(outfile, hdr, nplanes))) ERRX(_("Can't create output file"));
+        }
+        for(i = 0; i < n; ++i){
+            if(!cube_write_plane(out, planes[i])) ERRX(_("Can't write plane %ld"), p0 + i);
+            imfree(&planes[i]);
+        }
+    }
+    stream_close(&in);
+    if(!out || !stream_close(&out)) ERRX(_("Can't save output file"));
+}
+
+/**
+ * process image 'fits' with all its extensions (they are processed concurrently)
+ * @param fits - image (would be freed here)
+ * @return processed image(s) or NULL
+ */
+static IMAGE *process_fits(IMAGE *fits, bool pipe_need, int otype){
+    if(fits->next) return process_extensions(fits, pipe_need, otype);
+    return process_image(fits, pipe_need, otype);
+}
+
+/**
+ * process image 'fits' (read from file or result of group operation) & save result into 'outfile'
+ * @param fits      - image (would be freed here)
+ * @param outfile   - output file name or NULL
+ * @param pipe_need - TRUE if there's pipeline
+ * @param otype     - output data type or 0
+ * @return FALSE if image wasn't processed or saved
+ */
+static bool process_and_save(IMAGE *fits, char *outfile, bool pipe_need, int otype){
+    bool ret = TRUE;
+    IMAGE *newfit = process_fits(fits, pipe_need, otype);
+    if(!newfit) return FALSE;
+    if(outfile && !writeFITS(outfile, newfit)){
+        WARNX(_("Can't save file %s"), outfile);
+        ret = FALSE;
+    }
+    imfree(&newfit);
+    return ret;
+}
+
+/**
+ * get list of input files for batch mode
+ * @param batch - glob pattern or name of file with list of names ("-" for stdin)
+ * @param n (o) - amount of files
+ * @return NULL-terminated array of names or NULL if there's no files
+ */
+static char **batch_list(char *batch, int *n){
+    char **names = NULL, buf[PATH_MAX];
+    int N = 0, L = 0;
+    if(strpbrk(batch, "*?[")){
+        glob_t gl;
+        if(glob(batch, 0, NULL, &gl) == 0){
+            L = gl.gl_pathc + 1;
+            names = MALLOC(char*, L);
+            for(size_t i = 0; i < gl.gl_pathc; ++i) names[N++] = strdup(gl.gl_pathv[i]);
+        }
+        globfree(&gl);
+    }else{
+        FILE *f = strcmp(batch, "-") ? fopen(batch, "r") : stdin;
+        if(!f){
+            WARN(_("Can't open %s"), batch);
+            return NULL;
+        }
+        while(fgets(buf, PATH_MAX, f)){
+            char *s = buf, *e;
+            while(*s == ' ' || *s == '\t') ++s;
+            for(e = s + strlen(s); e > s && (e[-1] == '\n' || e[-1] == '\r' || e[-1] == ' '); --e);
+            *e = 0;
+            if(!*s || *s == '#') continue;
+            if(N + 1 >= L){
+                L += 1024;
+                if(!(names = realloc(names, L * sizeof(char*)))) ERR("realloc()");
+            }
+            names[N++] = strdup(s);
+        }
+        if(f != stdin) fclose(f);
+    }
+    if(!N){
+        FREE(names);
+        return NULL;
+    }
+    names[N] = NULL;
+    *n = N;
+    return names;
+}
+
+/**
+ * make output file name for input 'infile' by template 'tmpl' (%s - input name without extension)
+ * @return FALSE if name is too long
+ */
+static bool batch_outname(char *tmpl, char *infile, char *outfile){
+    char base[PATH_MAX], *dot;
+    snprintf(base, PATH_MAX, "%s", infile);
+    if((dot = strrchr(base, '.')) && !strchr(dot, '/')){
+        if(strcmp(dot, ".fz") == 0 || strcmp(dot, ".gz") == 0){ // double extension
+            *dot = 0;
+            if((dot = strrchr(base, '.')) && strchr(dot, '/')) dot = NULL;
+        }
+        if(dot) *dot = 0;
+    }
+    char *s = strstr(tmpl, "%s");
+    int l = snprintf(outfile, PATH_MAX, "%.*s%s%s", (int)(s - tmpl), tmpl, base, s + 2);
+    return (l < PATH_MAX);
+}
+
+/**
+ * make output file name for batch file 'infile' & check that it could be written
+ * (existing file is removed if user wants)
+ * @return FALSE if file should be skipped
+ */
+static bool batch_output(char *infile, char *outfile){
+    if(!batch_outname(G.batchout, infile, outfile)){
+        WARNX(_("Too long output file name for %s"), infile);
+        return FALSE;
+    }
+    if(strcmp(outfile, infile) == 0){
+        WARNX(_("Output file name is the same as input (%s), use --inplace"), infile);
+        return FALSE;
+    }
+    if(!file_absent(outfile)){
+        if(!rewrite_ifexists){
+            WARNX(_("The output file %s exists, skip %s"), outfile, infile);
+            return FALSE;
+        }
+        if(unlink(outfile)){
+            WARN(_("Can't remove file %s"), outfile);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * show statistics & tables of image 'fits' read from file 'infile' (if user wants)
+ */
+static void batch_info(char *infile, IMAGE *fits){
+    if(show_stat){
+        Item min, max, mean, std, med;
+        get_statictics(fits, &min, &max, &mean, &std, &med);
+        #pragma omp critical (stat_output)
+        {
+            green("%s: ", infile);
+            printf("min = %g, max = %g, mean = %g, std = %g, median = %g\n",
+                    min, max, mean, std, med);
+        }
+    }
+    if(G.listabs){
+        #pragma omp critical (stat_output)
+        {
+            green("%s:\n", infile);
+            table_print_all(fits);
+        }
+    }
+}
+
+/**
+ * process one file of batch
+ * @return FALSE if file can't be read
+ */
+static bool batch_file(char *infile, bool pipe_need, int otype){
+    char outfile[PATH_MAX];
+    FITSstream *cube;
+    IMAGE *fits = NULL;
+    if(inplace){
+        if(header_only(pipe_need, otype) && update_header(infile, edit_header)) return TRUE;
+        snprintf(outfile, PATH_MAX, "!%s", infile);
+    }else if(!batch_output(infile, outfile)) return FALSE;
+    if(!inplace && (cube = cube_open(infile))){
+        process_cube(cube, outfile, pipe_need, otype);
+        return TRUE;
+    }
+    if(!readFITS(infile, &fits)) return FALSE;
+    batch_info(infile, fits);
+    return process_and_save(fits, outfile, pipe_need, otype);
+}
+
+// file of batch in overlapped processing
+typedef struct{
+    char *infile;           // input file name
+    char outfile[PATH_MAX]; // output file name
+    IMAGE *img;             // image read (or result of processing)
+    FITSstream *cube;       // or data cube opened
+} batch_item;
+
+// arguments of reading thread
+typedef struct{
+    char **names;           // input files
+    int N;                  // amount of files
+    int nbad;               // amount of files which can't be read
+    ioqueue *q;             // queue for images read
+} batch_reader_args;
+
+/**
+ * thread reading files of batch in advance (with all their data)
+ */
+static void *batch_reader(void *arg){
+    batch_reader_args *a = (batch_reader_args*) arg;
+    for(int i = 0; i < a->N; ++i){
+        batch_item *it = MALLOC(batch_item, 1);
+        it->infile = a->names[i];
+        if(!batch_output(it->infile, it->outfile)){
+            ++a->nbad;
+            FREE(it);
+            continue;
+        }
+        if(!(it->cube = cube_open(it->infile)) && readFITS(it->infile, &it->img)){
+            for(IMAGE *cur = it->img; cur; cur = cur->next) image_load(cur);
+        }
+        if(!ioq_push(a->q, it)){
+            imfree(&it->img);
+            FREE(it);
+            break;
+        }
+    }
+    ioq_close(a->q);
+    return NULL;
+}
+
+/**
+ * thread writing results of batch processing
+ */
+static void *batch_writer(void *arg){
+    ioqueue *q = (ioqueue*) arg;
+    batch_item *it;
+    while((it = ioq_pop(q))){
+        if(!writeFITS(it->outfile, it->img)) WARNX(_("Can't save file %s"), it->outfile);
+        imfree(&it->img);
+        FREE(it);
+    }
+    return NULL;
+}
+
+/**
+ * process files of batch one by one overlapping I/O with computations:
+ * next file is read & previous result is written by separate threads while current one is processed
+ * (queues are bounded, so there's not more than BATCH_QUEUE_SIZE images waiting on each side)
+ * @return amount of files which weren't processed
+ */
+static int batch_overlapped(char **names, int N, bool pipe_need, int otype){
+    batch_reader_args rd = {.names = names, .N = N};
+    ioqueue *wq = ioq_new(BATCH_QUEUE_SIZE);
+    pthread_t reader, writer;
+    batch_item *it;
+    int nbad = 0;
+    rd.q = ioq_new(BATCH_QUEUE_SIZE);
+    if(pthread_create(&reader, NULL, batch_reader, &rd) || pthread_create(&writer, NULL, batch_writer, wq))
+        ERR(_("Can't create I/O thread"));
+    while((it = ioq_pop(rd.q))){
+        if(it->cube){
+            process_cube(it->cube, it->outfile, pipe_need, otype);
+        }else if(!it->img){
+            WARNX(_("Can't process file %s"), it->infile);
+            ++nbad;
+        }else{
+            batch_info(it->infile, it->img);
+            it->img = process_fits(it->img, pipe_need, otype); // input is freed like in batch_file
+            if(it->img){
+                ioq_push(wq, it);
+                continue;
+            }
+        }
+        FREE(it);
+    }
+    ioq_close(wq);
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    ioq_free(&rd.q);
+    ioq_free(&wq);
+    return nbad + rd.nbad;
+}
+
+/**
+ * batch mode: process all files given by G.batch with output names made by template G.batchout
+ * files are processed in parallel, amount of threads for each file depends on image size
+ * (small images are processed by one thread, large - by several)
+ */
+static void process_batch(bool pipe_need, int otype){
+    FNAME();
+    int i, N = 0, nbad = 0, inner = 1, outer;
+    char **names = batch_list(G.batch, &N);
+    IMAGE *first = NULL;
+    if(!names) ERRX(_("There's no files to process"));
+    if(!G.batchout) G.batchout = "%s_proc.fits";
+    char *s = strstr(G.batchout, "%s");
+    if(!inplace && (!s || strchr(s + 2, '%') || strchr(G.batchout, '%') != s))
+        ERRX(_("Output template should contain exactly one \"%%s\""));
+    // select threads per file by size of first image (headers only are read)
+    if(readFITS(names[0], &first)){
+        size_t npix = (size_t)first->width * first->height;
+        inner = MAX(1, MIN(THREAD_NUMBER, (int)(npix / BATCH_PIX_PER_THREAD)));
+        imfree(&first);
+    }
+    outer = MAX(1, MIN(N, THREAD_NUMBER / inner));
+    if(outer > 1 && !fits_is_reentrant()){
+        WARNX(_("cfitsio isn't reentrant, files would be processed one by one"));
+        outer = 1;
+        inner = THREAD_NUMBER;
+    }
+    DBG("%d files, %d files at once, %d threads per file", N, outer, inner);
+    if(outer == 1 && N > 1 && !inplace && fits_is_reentrant()){
+        // large images: all cores are busy with one file, so I/O is overlapped with processing
+        nbad = batch_overlapped(names, N, pipe_need, otype);
+    }else{
+#ifdef OMP_FOUND
+        omp_set_max_active_levels(2);
+#endif
+        OMP_FOR(num_threads(outer) schedule(dynamic) reduction(+:nbad))
+        for(i = 0; i < N; ++i){
+#ifdef OMP_FOUND
+            omp_set_num_threads(inner);
+#endif
+            if(!batch_file(names[i], pipe_need, otype)){
+                WARNX(_("Can't process file %s"), names[i]);
+                ++nbad;
+            }
+        }
+    }
+    if(nbad) WARNX(_("%d of %d files weren't processed"), nbad, N);
+    for(i = 0; i < N; ++i) FREE(names[i]);
+    FREE(names);
+}
+
+/**
+ * check that template 'tmpl' of output file names contains the only integer conversion
+ */
+static bool frame_template(char *tmpl){
+    char *s = strchr(tmpl, '%');
+    if(!s || strchr(s + 1, '%')) return FALSE;
+    s += 1 + strspn(s + 1, "0123456789");
+    return (*s == 'd');
+}
+
+/**
+ * put image 'img' into output ring buffer 'out' (created at first call by size & type of 'img')
+ * native data are stored as is, the rest - as double (BITPIX=-64)
+ * @return FALSE if frame has another size or type than previous frames
+ */
+static bool ring_output(shmring **out, IMAGE *img, int nslots){
+    void *data = image_pixels(img);
+    int bitpix = img->pix ? img->dtype : DOUBLE_IMG;
+    if(!*out && !(*out = shmring_create(G.ingestring, img->width, img->height, bitpix, nslots)))
+        ERRX(_("Can't create ring buffer %s"), G.ingestring);
+    shmring_hdr *h = (*out)->hdr;
+    if((int)h->width != img->width || (int)h->height != img->height || h->bitpix != bitpix){
+        WARNX(_("Frame size or type changed, it can't be put into %s"), G.ingestring);
+        return FALSE;
+    }
+    memcpy(shmring_reserve(*out), data, shmring_framesize(*out));
+    shmring_commit(*out);
+    return TRUE;
+}
+
+/**
+ * ingest mode: process raw frames from shared memory ring buffer G.ingest as they arrive
+ * results are saved into files by template G.ingestout and/or put into ring buffer G.ingestring
+ */
+static void process_ingest(bool pipe_need, int otype){
+    FNAME();
+    char outfile[PATH_MAX], rec[FLEN_CARD];
+    if(!G.ingestout && !G.ingestring)
+        ERRX(_("Set output file names template (--ingest-out) or output ring buffer (--ingest-ring)"));
+    if(G.ingestout && !frame_template(G.ingestout))
+        ERRX(_("Output template should contain exactly one integer conversion like \"%%04d\""));
+    shmring *in = shmring_attach(G.ingest, G.ingestwait), *out = NULL;
+    if(!in) ERRX(_("Can't attach to ring buffer %s"), G.ingest);
+    size_t w = in->hdr->width, h = in->hdr->height;
+    int bitpix = in->hdr->bitpix, nbad = 0;
+    long nframe = 0;
+    uint8_t *frame;
+    double t0 = dtime();
+    DBG("ring %s: %zdx%zd, BITPIX=%d, %u slots", G.ingest, w, h, bitpix, in->hdr->nslots);
+    while((frame = shmring_get(in))){
+        IMAGE *img = buildFITSfromdat(h, w, bitpix, frame);
+        shmring_release(in); // frame is copied, so producer could reuse its slot
+        snprintf(rec, FLEN_CARD, "FRAMENUM= %20ld / number of frame in ring buffer", nframe);
+        list_add_record(&img->keylist, rec);
+        IMAGE *res = process_image(img, pipe_need, otype); // frame image is freed there
+        if(!res) ERRX(_("Can't process frame %ld"), nframe);
+        if(G.ingestout){
+            snprintf(outfile, PATH_MAX, G.ingestout, (int)nframe);
+            if(rewrite_ifexists && !file_absent(outfile) && unlink(outfile))
+                WARN(_("Can't remove file %s"), outfile);
+            if(!writeFITS(outfile, res)){
+                WARNX(_("Can't save file %s"), outfile);
+                ++nbad;
+            }
+        }
+        if(G.ingestring && !ring_output(&out, res, in->hdr->nslots)) ++nbad;
+        imfree(&res);
+        ++nframe;
+    }
+    t0 = dtime() - t0;
+    green(_("%ld frames processed in %.2f seconds (%.1f frames per second)\n"), nframe, t0, t0 > 0. ? nframe / t0 : 0.);
+    if(nbad) WARNX(_("%d of %ld frames weren't saved"), nbad, nframe);
+    if(out){
+        shmring_finish(out);
+        if(!shmring_wait_empty(out, G.ingestwait))
+            WARNX(_("Not all frames were read from %s"), G.ingestring);
+        shmring_close(&out);
+    }
+    shmring_close(&in);
+}
+
+// daemon mode: statistics shared by supervisor & worker processes
+typedef struct{
+    double start;       // time of daemon start
+    long jobs;          // amount of jobs
+    long failed;        // amount of failed jobs
+    long restarts;      // amount of worker restarts
+    double jobtime;     // total time of all jobs
+    double lasttime;    // time of last job
+    bool busy;          // worker is processing a job
+    bool quit;          // "quit" command received
+} daemon_stat;
+static daemon_stat *dstat = NULL;
+
+/**
+ * daemon mode: process job "infile outfile [pipeline]..." (pipeline stages are like arguments of '-p')
+ * @param job   - job line (would be changed)
+ * @param reply - buffer for error message
+ * @return FALSE if job failed
+ */
+static bool daemon_job(char *job, int otype, char *reply, size_t rlen){
+    char *words[DAEMON_MAX_STAGES + 3], *w, *saveptr = NULL;
+    int n = 0;
+    for(w = strtok_r(job, " \t\r\n", &saveptr); w && n < DAEMON_MAX_STAGES + 2; w = strtok_r(NULL, " \t\r\n", &saveptr))
+        words[n++] = w;
+    words[n] = NULL;
+    if(w){
+        snprintf(reply, rlen, "more than %d pipeline stages", DAEMON_MAX_STAGES);
+        return FALSE;
+    }
+    if(n < 2){
+        snprintf(reply, rlen, "usage: infile outfile [pipeline]...");
+        return FALSE;
+    }
+    char *infile = words[0], *outfile = words[1];
+    IMAGE *fits = NULL;
+    char *bad = NULL;
+    G.conv = &words[2];
+    bool pipe_need = get_pipeline_params(&bad);
+    G.conv = NULL;
+    if(bad){ // wrong stage shouldn't kill the worker
+        snprintf(reply, rlen, "bad pipeline stage %s", bad);
+        return FALSE;
+    }
+    if(!readFITS(infile, &fits)){
+        snprintf(reply, rlen, "can't read %s", infile);
+        return FALSE;
+    }
+    if(!file_absent(outfile)){
+        if(!rewrite_ifexists){
+            imfree(&fits);
+            snprintf(reply, rlen, "%s exists", outfile);
+            return FALSE;
+        }
+        for(IMAGE *cur = fits; cur; cur = cur->next) image_load(cur);
+        if(unlink(outfile)){
+            imfree(&fits);
+            snprintf(reply, rlen, "can't remove %s", outfile);
+            return FALSE;
+        }
+    }
+    // image is freed there in any case, so long-living worker doesn't grow from job to job
+    if(!process_and_save(fits, outfile, pipe_need, otype)){
+        snprintf(reply, rlen, "can't process %s", infile);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * daemon mode: worker process serving clients one by one;
+ * each line from client is a job or command ("status" or "quit"), each job gets reply
+ * "OK time" or "ERR message"; FFTW threads, OpenMP threads & heap are kept between jobs
+ */
+static void daemon_worker(int sock, int otype){
+    char line[BUFF_SIZ], reply[BUFF_SIZ];
+    prctl(PR_SET_PDEATHSIG, SIGTERM); // don't outlive supervisor
+    while(!dstat->quit){
+        int fd = accept(sock, NULL, NULL);
+        if(fd < 0){
+            if(errno != EINTR) WARN(_("Can't accept connection"));
+            continue;
+        }
+        FILE *f = fdopen(fd, "r");
+        while(!dstat->quit && fgets(line, BUFF_SIZ, f)){
+            if(!strchr(line, '\n') && !feof(f)){ // skip the rest of too long line
+                int c;
+                while((c = fgetc(f)) != EOF && c != '\n');
+                dprintf(fd, "ERR line is too long\n");
+                continue;
+            }
+            char *cmd = line + strspn(line, " \t\r\n");
+            if(!*cmd) continue;
+            if(strncmp(cmd, "status", 6) == 0){
+                dprintf(fd, "OK jobs=%ld failed=%ld restarts=%ld uptime=%.1f mean=%.4f last=%.4f\n",
+                    dstat->jobs, dstat->failed, dstat->restarts, dtime() - dstat->start,
+                    dstat->jobs ? dstat->jobtime / dstat->jobs : 0., dstat->lasttime);
+                continue;
+            }
+            if(strncmp(cmd, "quit", 4) == 0){
+                dstat->quit = TRUE;
+                dprintf(fd, "OK\n");
+                break;
+            }
+            double t0 = dtime();
+            dstat->busy = TRUE;
+            bool ok = daemon_job(cmd, otype, reply, BUFF_SIZ);
+            dstat->busy = FALSE;
+            t0 = dtime() - t0;
+            ++dstat->jobs;
+            dstat->jobtime += t0;
+            dstat->lasttime = t0;
+            if(ok) dprintf(fd, "OK %.4f\n", t0);
+            else{
+                ++dstat->failed;
+                dprintf(fd, "ERR %s\n", reply);
+            }
+        }
+        fclose(f);
+    }
+}
+
+/**
+ * daemon mode: listen UNIX socket G.daemon & process jobs by worker process;
+ * fatal errors in job kill worker, then it is restarted by supervisor (client gets EOF instead of reply)
+ */
+static void process_daemon(int otype){
+    FNAME();
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct stat st;
+    if(strlen(G.daemon) >= sizeof(addr.sun_path)) ERRX(_("Too long socket path: %s"), G.daemon);
+    strcpy(addr.sun_path, G.daemon);
+    if(stat(G.daemon, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(G.daemon); // socket of previous run
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock < 0) ERR(_("Can't create socket"));
+    if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) || listen(sock, DAEMON_BACKLOG))
+        ERR(_("Can't listen socket %s"), G.daemon);
+    dstat = mmap(NULL, sizeof(daemon_stat), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(dstat == MAP_FAILED) ERR(_("Can't allocate shared memory"));
+    memset(dstat, 0, sizeof(daemon_stat));
+    dstat->start = dtime();
+    signal(SIGPIPE, SIG_IGN); // client could close connection before reply
+    green(_("Listening socket %s\n"), G.daemon);
+    while(!dstat->quit){
+        pid_t pid = fork();
+        if(pid < 0) ERR(_("Can't fork"));
+        if(pid == 0){
+            daemon_worker(sock, otype);
+            exit(0);
+        }
+        int status = 0;
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        if(dstat->quit) break;
+        if(dstat->busy){ // job killed worker
+            ++dstat->jobs;
+            ++dstat->failed;
+            dstat->busy = FALSE;
+        }
+        ++dstat->restarts;
+        WARNX(_("Worker process died (status %d), restart it"), status);
+        sleep(1);
+    }
+    close(sock);
+    unlink(G.daemon);
+    munmap(dstat, sizeof(daemon_stat));
+}
 
 int main(int argc, char **argv){
-    IMAGE *fits = NULL, *newfit = NULL;
+    IMAGE *fits = NULL;
     bool pipe_need = FALSE;
+    int otype = 0; // output data type
     char buff[BUFF_SIZ];
     //size_t i, s;
     initial_setup();
     parse_args(argc, argv);
+    // FITS data would be written into stdout: all messages go to stderr
+    if(G.outfile && strcmp(G.outfile, "-") == 0) stdout_reserve();
     // pre-check pipeline parameters
     if(G.conv){
-        pipe_need = get_pipeline_params();
+        pipe_need = get_pipeline_params(NULL);
+    }
+    if(G.otype && !(otype = parse_bitpix(G.otype)))
+        ERRX(_("Wrong output data type: %s"), G.otype);
+    if(!fftw_set_planner(G.fftwplan, G.wisdom))
+        ERRX(_("Wrong FFTW planning mode: %s"), G.fftwplan);
+    FITScompress zc;
+    if(!fitscomp_parse(&zc))
+        ERRX(_("Wrong compression parameters"));
+    if(G.batch){
+        if(G.infile || G.oper != MATH_NONE) ERRX(_("Batch mode can't be used with '-i' or group operations"));
+        process_batch(pipe_need, otype);
+        return 0;
+    }
+    if(G.ingest){
+        if(G.infile || inplace || G.oper != MATH_NONE)
+            ERRX(_("Ingest mode can't be used with '-i', '--inplace' or group operations"));
+        process_ingest(pipe_need, otype);
+        return 0;
+    }
+    if(G.daemon){
+        if(G.infile || inplace || G.oper != MATH_NONE || G.conv)
+            ERRX(_("Daemon mode can't be used with '-i', '-p', '--inplace' or group operations"));
+        process_daemon(otype);
+        return 0;
     }
     if(!G.infile && G.oper == MATH_NONE){
         /// "    "
@@ -102,7 +999,22 @@ int main(int argc, char **argv){
             }
         }
     }
-    if((G.infile) && !readFITS(G.infile, &fits)){
+    // stdin could be read only once & entirely
+    bool fromstdin = G.infile && (strcmp(G.infile, "-") == 0 || strncmp(G.infile, "stdin", 5) == 0);
+    if(fromstdin && inplace) ERRX(_("Can't process stdin 'in place'"));
+    bool bystrips = (G.infile && G.striph > 0 && !fromstdin);
+    if(bystrips && inplace){
+        WARNX(_("Can't process image by strips 'in place'"));
+        bystrips = FALSE;
+    }
+    // header edition: change header blocks of file without rewriting data
+    if(header_only(pipe_need, otype) && update_header(G.infile, edit_header)) return 0;
+    FITSstream *cube = NULL; // data cubes are processed plane by plane
+    if(G.infile && !fromstdin && (cube = cube_open(G.infile))){
+        if(inplace) ERRX(_("Can't process data cube 'in place'"));
+        bystrips = FALSE;
+    }
+    if(!bystrips && !cube && (G.infile) && !readFITS(G.infile, &fits)){
         // "   !"
         ERR(_("Can't read input file!"));
     }
@@ -125,9 +1037,11 @@ int main(int argc, char **argv){
             else
                 G.rest_pars = NULL;
         }
-    }else{ // check whether file don't exists or there's a key '--rewrite'
+    }else if(strcmp(G.outfile, "-")){ // check whether file don't exists or there's a key '--rewrite'
         if(!file_absent(G.outfile)){
             if(rewrite_ifexists || inplace){
+                // input file could be removed: read all its data now
+                for(IMAGE *cur = fits; cur; cur = cur->next) image_load(cur);
                 /// "    %s"
                 if(unlink(G.outfile)) ERR(_("Can't remove file %s"), G.outfile);
             }else{
@@ -136,6 +1050,17 @@ int main(int argc, char **argv){
             }
         }
     }
+    if(cube){
+        process_cube(cube, G.outfile, pipe_need, otype);
+        return 0;
+    }
+    if(bystrips){
+        if(process_by_strips(pipe_need, otype)) return 0;
+        if(!readFITS(G.infile, &fits)){
+            // "   !"
+            ERR(_("Can't read input file!"));
+        }
+    }
     // Process pipeline only if there's
     if(G.infile){
         if(show_stat){
@@ -169,74 +1094,7 @@ int main(int argc, char **argv){
             }
         }
     }
-    // process pipeline both in case of single input file ('-i')
-    if(pipe_need)
-        newfit = process_pipeline(fits);
-
-    if(show_stat && newfit){
-        Item min, max, mean, std, med;
-        get_statictics(newfit, &min, &max, &mean, &std, &med);
-        // "    :\n"
-        green(_("Image statistics after pipeline:\n"));
-        printf("min = %g, max = %g, mean = %g, std = %g, median = %g\n",
-                min, max, mean, std, med);
-    }
-    if(!newfit) newfit = fits;
-    // process cuts & so on
-    cut_bounds(newfit, G.low_bound, G.up_bound);
-    if(!newfit) signals(-1);
-    // here are operations that can't be done together
-    if(G.binarize < DBL_MAX - 1.){
-        IMAGE *tmp = get_binary(newfit, G.binarize);
-        imfree(&newfit);
-        newfit = tmp;
-    }else if(G.conncomp4 < DBL_MAX - 1.){
-        size_t n;
-        IMAGE *tmp = cclabel4(newfit, G.conncomp4, &n);
-        imfree(&newfit);
-        newfit = tmp;
-        green("Found %d 4-connected regions\n", n);
-    }else if(G.conncomp8 < DBL_MAX - 1.){
-        size_t n;
-        IMAGE *tmp = cclabel8(newfit, G.conncomp8, &n);
-        imfree(&newfit);
-        newfit = tmp;
-        green("Found %d 8-connected regions\n", n);
-    }
-    if(!newfit) return 0;
-    /**************************************************************************************************************
-     *
-     * place here any other operations with [processed through pipeline] input file or result of group operations
-     *    (newfit)
-     *
-     **************************************************************************************************************/
-    // change keys in output file FITS-header
-    if(keys2delete){
-        DBG("delete keys");
-        do{
-            list_remove_key(&newfit->keylist, *keys2delete);
-        }while(*(++keys2delete));
-    }
-    if(recs2delete){
-        DBG("delete records");
-        do{
-            list_remove_records(&newfit->keylist, *recs2delete);
-        }while(*(++recs2delete));
-    }
-    if(recs2add){
-        DBG("add records");
-        do{
-            list_add_record(&newfit->keylist, *recs2add);
-        }while(*(++recs2add));
-    }
-
-    // process flipping
-    if(G.flip){
-        char *flip = G.flip;
-        if(strchr(flip, 'x') || strchr(flip, 'X')) flip_X(newfit);
-        if(strchr(flip, 'y') || strchr(flip, 'Y')) flip_Y(newfit);
-    }
-    writeFITS(G.outfile, newfit);
+    process_and_save(fits, G.outfile, pipe_need, otype);
 
     return 0;
 }
@@ -24,10 +24,25 @@
 
 #include "fits.h"
 #include "types.h"
+#include "pixtypes.h"
 
 IMAGE *get_median(IMAGE *img, Filter *f, Itmarray *i);
 IMAGE *get_adaptive_median(IMAGE *img, Filter *f, Itmarray *i);
 Item quick_select(Item *idata, int n);
 Item calc_median(Item *idata, int n);
 
+// the same for native pixel types
+uint8_t quick_select_u8(uint8_t *idata, int n);
+int16_t quick_select_i16(int16_t *idata, int n);
+uint16_t quick_select_u16(uint16_t *idata, int n);
+int32_t quick_select_i32(int32_t *idata, int n);
+float quick_select_f32(float *idata, int n);
+// median of array (modified by function)
+Item median_inplace(Item *arr, int n);
+uint8_t median_inplace_u8(uint8_t *arr, int n);
+int16_t median_inplace_i16(int16_t *arr, int n);
+uint16_t median_inplace_u16(uint16_t *arr, int n);
+int32_t median_inplace_i32(int32_t *arr, int n);
+float median_inplace_f32(float *arr, int n);
+
 #endif // __MEDIAN_H__
@@ -33,6 +33,7 @@ static size_t farray_size = 0;
 typedef struct{
 	char *ftype;
 	char *scale;
+	char *method;
 	int help;
 	int xsz;
 	int ysz;
@@ -51,6 +52,8 @@ typedef struct{
 
 /// "sx,sy\t    x  y\nw,h\t     "
 char* lgargs = N_("sx,sy\tsigma by axes x & y\nw,h\tnon-zero window width & height");
+char* gaussargs = N_("sx,sy\tsigma by axes x & y\nw,h\tnon-zero window width & height\n"
+	"method\tauto, fft (2-D convolution), sep (two 1-D convolutions) or iir (recursive, window is ignored)");
 /// " "
 char* noneargs = N_("arguments are absent");
 /// "r\t  (   0  \"\" 3x3)"
@@ -66,7 +69,7 @@ ftypename filter_names[] = {
 	/// " "
 	{LAPGAUSS,  "lapgauss",  N_("laplasian of gaussian"), &lgargs, DiffFilter},
 	/// " "
-	{GAUSS,     "gauss",     N_("gaussian"), &lgargs, DiffFilter},
+	{GAUSS,     "gauss",     N_("gaussian"), &gaussargs, GaussFilter},
 	/// "  "
 	{SOBELH,    "sobelh",    N_("horizontal Sobel"), &noneargs, DiffFilter},
 	/// "  "
@@ -104,8 +107,17 @@ void showparhelp(int idx){
 	signals(9);
 }
 
-Filter *parse_filter(char *pars){
-	Filter *fltr;
+// wrong stage parameters: exit or (in daemon mode) only warn & return NULL
+#define BADPARS(...) do{if(fatal) ERRX(__VA_ARGS__); WARNX(__VA_ARGS__); goto bad;}while(0)
+
+/**
+ * parse parameters of pipeline stage
+ * @param pars  - stage parameters (like argument of '-p')
+ * @param fatal - TRUE to exit on wrong parameters or help request, FALSE to return NULL
+ * @return filter or NULL
+ */
+Filter *parse_filter(char *pars, bool fatal){
+	Filter *fltr = NULL;
 	int idx = -1;
 	pipepars popts;
 	mysuboption pipeopts[] = {
@@ -124,18 +136,21 @@ Filter *parse_filter(char *pars){
 		// posterisation
 		{"nsteps",NEED_ARG,arg_int,    &popts.xsz},
 		{"scale",NEED_ARG, arg_string, &popts.scale},
+		// method of Gaussian filtering
+		{"method",NEED_ARG,arg_string, &popts.method},
 		end_suboption
 	};
 	memset(&popts, 0, sizeof(pipepars));
 	if(!get_suboption(pars, pipeopts)){
-		return NULL;
+		goto bad;
 	}else{
 		if(!popts.ftype){ // no type given
 			/// "      'type', : '-p type=help'"
-			ERRX(_("You should at least give parameter 'type', for example: '-p type=help'"));
+			BADPARS(_("You should at least give parameter 'type', for example: '-p type=help'"));
 		}
 		DBG("type: %s", popts.ftype);
 		if(strcmp(popts.ftype, "help") == 0){ // info about pipeline names
+			if(!fatal) goto bad;
 			show_pipeline_pars();
 		}
 		int i = 0;
@@ -149,10 +164,12 @@ Filter *parse_filter(char *pars){
 		if(idx == -1){ // wrong type
 			/// "  'type' "
 			WARNX(_("Wrong pipeline 'type' parameter: %s"), popts.ftype);
+			if(!fatal) goto bad;
 			show_pipeline_pars();
 		}
 	}
 	if(popts.help){ // help about current filter options
+		if(!fatal) goto bad;
 		showparhelp(idx);
 	}
 	fltr = MALLOC(Filter, 1);
@@ -163,8 +180,7 @@ Filter *parse_filter(char *pars){
 	// check parameters & fill Filer fields
 	if(popts.imfunc ==  get_median || popts.imfunc == get_adaptive_median){
 		fltr->w = popts.xsz;
-	}else if(popts.imfunc ==  DiffFilter &&
-			(fltr->FilterType == LAPGAUSS || fltr->FilterType == GAUSS)){
+	}else if(fltr->FilterType == LAPGAUSS || fltr->FilterType == GAUSS){
 		if(popts.xsz < 5){
 			// "    5"
 			WARNX(_("Filter window width changed to 5"));
@@ -177,21 +193,34 @@ Filter *parse_filter(char *pars){
 		}
 		if(popts.xhw < 1. || popts.yhw < 1.){
 			/// "      1."
-			ERRX(_("Filter FWHM should be not less than 1."));
+			BADPARS(_("Filter FWHM should be not less than 1."));
 		}
 		fltr->w = popts.xsz; fltr->h = popts.ysz;
 		fltr->sx = popts.xhw; fltr->sy = popts.yhw;
+		if(popts.method && fltr->FilterType == GAUSS){
+			int i = 0, idx = -1;
+			while(gauss_methods[i].name){
+				if(!strcmp(popts.method, gauss_methods[i].name)){
+					idx = i; break;
+				}
+				++i;
+			}
+			if(idx == -1){
+				BADPARS(_("Gaussian filter parameters should be:\n%s"), gaussargs);
+			}
+			fltr->method = gauss_methods[idx].method;
+		}
 	}else if(popts.imfunc ==  StepFilter){ // check levels & type
 		if(popts.xsz < 2 || popts.xsz > 255){
 			/// "       2  255"
-			ERRX(_("Brightness levels amount shoul be from 2 to 255"));
+			BADPARS(_("Brightness levels amount shoul be from 2 to 255"));
 		}
 		fltr->w = popts.xsz;
 		int i = 0, idx = -1;
 		DBG("name: %s", popts.scale);
 		if(!popts.scale){
 			/// "   scale"
-			ERRX(_("You should set 'scale' parameter"));
+			BADPARS(_("You should set 'scale' parameter"));
 		}
 		while(scales[i].name){
 			if(!strcmp(popts.scale, scales[i].name)){
@@ -201,7 +230,7 @@ Filter *parse_filter(char *pars){
 		}
 		if(idx == -1){
 			/// "     :\n%s"
-			ERRX(_("Posterisation filter parameters should be:\n%s"), stepargs);
+			BADPARS(_("Posterisation filter parameters should be:\n%s"), stepargs);
 		}
 		DBG("idx: %d", idx);
 		fltr->h = scales[idx].type;
@@ -209,18 +238,41 @@ Filter *parse_filter(char *pars){
 	fltr->imfunc = popts.imfunc;
 	DBG("Got filter #%d: w=%d, h=%d, sx=%g, sy=%g\n", fltr->FilterType,
 		fltr->w, fltr->h, fltr->sx, fltr->sy);
+	goto ret;
+bad:
+	if(fltr){
+		FREE(fltr->name);
+		FREE(fltr);
+	}
+ret:
+	FREE(popts.ftype);
+	FREE(popts.scale);
+	FREE(popts.method);
 	return fltr;
 }
+#undef BADPARS
+
+// free array of pipeline parameters
+static void free_pipeline(){
+	for(size_t i = 0; i < farray_size; ++i){
+		FREE(farray[i]->name);
+		FREE(farray[i]);
+	}
+	FREE(farray);
+	farray_size = 0;
+}
 
 /*
  * makes array of pipeline parameters
  * if any found, return TRUE
  * else return FALSE
+ * if 'bad' isn't NULL, wrong stage isn't fatal: it is stored in 'bad' & FALSE returned
  */
-bool get_pipeline_params(){
+bool get_pipeline_params(char **bad){
 	int i, N;
 	char **p = G.conv;
 	Filter *f;
+	free_pipeline(); // previous pipeline (daemon mode: pipeline is given for each job)
 	for(N = 0; *p; ++N, ++p);
 	farray_size = N;
 	if(N == 0) return FALSE;
@@ -228,7 +280,16 @@ bool get_pipeline_params(){
 	p = G.conv;
 	for(i = 0; i < N; ++i, ++p){
 		DBG("filter: %s", *p);
-		if(!(f = parse_filter(*p))){
+		char *stage = strdup(*p); // parser spoils its argument
+		f = parse_filter(stage, !bad);
+		FREE(stage);
+		if(!f){
+			if(bad){ // drop already parsed stages
+				*bad = *p;
+				farray_size = i;
+				free_pipeline();
+				return FALSE;
+			}
 			/// "   "
 			ERRX(_("Wrong pipeline parameters!"));
 		}
@@ -237,62 +298,67 @@ bool get_pipeline_params(){
 	return TRUE;
 }
 
-IMAGE *process_pipeline(IMAGE *image){
-	if(!image){
-		/// "   "
-		ERRX(_("No input image given"));
-	}
-	if(!farray || !farray_size){
-		/// "   "
-		WARNX(_("No pipeline parameters given"));
+/**
+ * add table with conversion results 'oarg' of filter 'f' to image 'processed'
+ */
+static void add_oarg_table(IMAGE *processed, Filter *f, Itmarray *oarg){
+	size_t i, l = oarg->size;
+	//if(verbose_level){
+		green("got oarg: \n");
+		for(i = 0; i < l; ++i){
+			printf("%5zd: %g\n", i, oarg->data[i]);
+		}
+	//}
+	char tabname[80];
+	snprintf(tabname, 80, "%s_CONVERSION", f->name);
+	FITStable *tab = table_new(processed, tabname);
+	if(tab){
+		table_column col = {
+			.width = sizeof(int32_t),
+			.repeat = l,
+			.coltype = TINT
+		};
+		int32_t *levls = MALLOC(int32_t, l);
+		for(i = 0; i < l; ++i) levls[i] = (int32_t) i;
+		col.contents = levls;
+		sprintf(col.colname, "level");
+		*col.unit = 0;
+		table_addcolumn(tab, &col);
+		FREE(levls);
+		col.contents = oarg->data;
+		col.coltype = TDOUBLE;
+		col.width = sizeof(double),
+		sprintf(col.colname, "value");
+		sprintf(col.unit, "ADU");
+		table_addcolumn(tab, &col);
+		printf("Create table:\n");
+		table_print(tab);
 	}
+}
+
+/**
+ * run first 'nstages' filters of pipeline over image 'in'
+ * @param in      - input image (would be freed here)
+ * @param nstages - amount of filters to run
+ * @param verbose - if FALSE, don't show messages & don't make tables with conversion results
+ */
+static IMAGE *pipeline_run(IMAGE *in, size_t nstages, bool verbose){
 	size_t i;
 	Filter **far = farray;
-	IMAGE *in = copyFITS(image); // copy original image to leave it unchanged
-	IMAGE *processed = NULL;
-	for(i = 0; i < farray_size; ++i, ++far){
+	IMAGE *processed = in;
+	if(nstages > farray_size) nstages = farray_size;
+	for(i = 0; i < nstages; ++i, ++far){
 		Filter *f = *far;
 		DBG("Got filter #%d: w=%d, h=%d, sx=%g, sy=%g\n", f->FilterType,
 			f->w, f->h, f->sx, f->sy);
-		printf("try filter %zd\n", i);
+		if(verbose) printf("try filter %zd\n", i);
 		Itmarray oarg = {NULL, 0};
-		processed = f->imfunc(in, f, &oarg);
+		processed = f->imfunc(in, f, verbose ? &oarg : NULL);
 		/// "   "
 		if(!processed) ERRX(_("Error on pipeline processing!"));
 		// TODO: what should I do with oarg???
 		if(oarg.size){
-			size_t i, l = oarg.size;
-			//if(verbose_level){
-				green("got oarg: \n");
-				for(i = 0; i < l; ++i){
-					printf("%5zd: %g\n", i, oarg.data[i]);
-				}
-			//}
-			char tabname[80];
-			snprintf(tabname, 80, "%s_CONVERSION", f->name);
-			FITStable *tab = table_new(processed, tabname);
-			if(tab){
-				table_column col = {
-					.width = sizeof(int32_t),
-					.repeat = l,
-					.coltype = TINT
-				};
-				int32_t *levls = MALLOC(int32_t, l);
-				for(i = 0; i < l; ++i) levls[i] = (int32_t) i;
-				col.contents = levls;
-				sprintf(col.colname, "level");
-				*col.unit = 0;
-				table_addcolumn(tab, &col);
-				FREE(levls);
-				col.contents = oarg.data;
-				col.coltype = TDOUBLE;
-				col.width = sizeof(double),
-				sprintf(col.colname, "value");
-				sprintf(col.unit, "ADU");
-				table_addcolumn(tab, &col);
-				printf("Create table:\n");
-				table_print(tab);
-			}
+			add_oarg_table(processed, f, &oarg);
 			FREE(oarg.data);
 		}
 		processed->keylist = in->keylist;
@@ -307,3 +373,104 @@ IMAGE *process_pipeline(IMAGE *image){
 	return processed;
 }
 
+IMAGE *process_pipeline(IMAGE *image){
+	if(!image){
+		/// "   "
+		ERRX(_("No input image given"));
+	}
+	if(!farray || !farray_size){
+		/// "   "
+		WARNX(_("No pipeline parameters given"));
+	}
+	IMAGE *in = copyFITS(image); // copy original image to leave it unchanged
+	return pipeline_run(in, farray_size, TRUE);
+}
+
+/**
+ * amount of halo rows needed to process first 'nstages' filters by strips
+ * @return -1 if some of filters can't work with strips
+ */
+static int stages_halo(size_t nstages){
+	size_t i;
+	int halo = 0;
+	if(nstages > farray_size) nstages = farray_size;
+	for(i = 0; i < nstages; ++i){
+		Filter *f = farray[i];
+		if(f->imfunc == get_median) // cross 3x3 for zero radius
+			halo += MAX(f->w, 1);
+		else if(f->imfunc == get_adaptive_median) // 5x5 for bad pixels
+			halo += MAX(f->w, 2);
+		else if(f->imfunc == StepFilter) // pixel-by-pixel
+			continue;
+		else return -1;
+	}
+	return halo;
+}
+
+/**
+ * amount of halo rows (above & below strip) needed for pipeline
+ * @return -1 if pipeline can't be processed by strips
+ */
+int pipeline_halo(){
+	return stages_halo(farray_size);
+}
+
+/**
+ * find data range after first 'nstages' filters processed by strips
+ * @param s (io)     - input stream (would be rewinded)
+ * @param nstages    - amount of filters
+ * @param min, max(o)- data range
+ * @return FALSE if failed
+ */
+bool pipeline_range(FITSstream *s, size_t nstages, Item *min, Item *max){
+	FNAME();
+	int halo = stages_halo(nstages), top, nrows;
+	if(!s || halo < 0) return FALSE;
+	Item mn = DBL_MAX, mx = -DBL_MAX;
+	IMAGE *strip;
+	s->halo = halo;
+	stream_rewind(s);
+	while((strip = stream_read_strip(s, &top, &nrows))){
+		IMAGE *res = pipeline_run(strip, nstages, FALSE);
+		size_t i, N = (size_t)nrows * res->width;
+		Item *data = &image_data(res)[top * res->width];
+		for(i = 0; i < N; ++i, ++data){
+			if(*data < mn) mn = *data;
+			if(*data > mx) mx = *data;
+		}
+		imfree(&res);
+	}
+	stream_rewind(s);
+	if(mn > mx) return FALSE;
+	DBG("range after %zd stages: [%g, %g]", nstages, mn, mx);
+	if(min) *min = mn;
+	if(max) *max = mx;
+	return TRUE;
+}
+
+/**
+ * prepare pipeline for processing by strips: find data ranges for filters which need them
+ * @param s (io) - input stream (would be rewinded)
+ * @return FALSE if pipeline can't work with strips
+ */
+bool pipeline_prepare_strips(FITSstream *s){
+	size_t i;
+	if(pipeline_halo() < 0) return FALSE;
+	for(i = 0; i < farray_size; ++i){
+		Filter *f = farray[i];
+		if(f->imfunc != StepFilter) continue;
+		if(!pipeline_range(s, i, &f->min, &f->max)) return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * process strip of image (should be called after pipeline_prepare_strips)
+ * @param strip - image strip with halo (would be freed here)
+ * @param first - TRUE for first strip (to fill output header & tables)
+ * @return processed strip
+ */
+IMAGE *process_pipeline_strip(IMAGE *strip, bool first){
+	if(!strip) return NULL;
+	return pipeline_run(strip, farray_size, first);
+}
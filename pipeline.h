@@ -25,7 +25,12 @@
 #include <stdbool.h>
 #include "fits.h"
 
-bool get_pipeline_params();
+bool get_pipeline_params(char **bad);
 IMAGE* process_pipeline(IMAGE *image);
 
+int pipeline_halo();
+bool pipeline_range(FITSstream *s, size_t nstages, Item *min, Item *max);
+bool pipeline_prepare_strips(FITSstream *s);
+IMAGE *process_pipeline_strip(IMAGE *strip, bool first);
+
 #endif // __PIPELINE_H__
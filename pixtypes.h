@@ -0,0 +1,60 @@
+/*
+ * pixtypes.h - native pixel types of images
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __PIXTYPES_H__
+#define __PIXTYPES_H__
+
+#include <stdint.h>
+#include "fits.h"
+
+/*
+ * Kernels for different pixel types are written once in "template" files
+ * (without file guards) using PIXTYPE as pixel type and TFN(name) as function name.
+ * To instantiate them for all types do:
+ *		#define TMPL_FILE "some_kernels.h"
+ *		#include "pixtypes_inst.h"
+ *		#undef TMPL_FILE
+ * Functions for Item (double) have no suffix, for other types suffixes are
+ * _u8, _i16, _u16, _i32 and _f32
+ */
+#define _TCAT(a, b)		a ## b
+#define TCAT(a, b)		_TCAT(a, b)
+#define TFN(name)		TCAT(name, PIXSFX)
+
+// pointer to image data: native or widened to double (pixels are read if needed)
+#define PIXPTR(img)		((img)->pix ? (img)->pix : image_pixels(img))
+
+// CALL(type, suffix) for each native type of image data
+#define PIX_CASES(CALL)							\
+	case BYTE_IMG:		CALL(uint8_t, _u8);		break;	\
+	case SHORT_IMG:		CALL(int16_t, _i16);	break;	\
+	case USHORT_IMG:	CALL(uint16_t, _u16);	break;	\
+	case LONG_IMG:		CALL(int32_t, _i32);	break;	\
+	case FLOAT_IMG:		CALL(float, _f32);		break;
+
+// run CALL(type, suffix) for type of image data (CALL(Item, ) if data is double)
+#define PIX_DISPATCH(img, CALL) do{							\
+	image_load(img);										\
+	if(!(img)->pix){ image_data(img); CALL(Item, ); }		\
+	else switch((img)->dtype){ PIX_CASES(CALL) default: break; }	\
+}while(0)
+
+#endif // __PIXTYPES_H__
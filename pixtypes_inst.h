@@ -0,0 +1,100 @@
+/*
+ * pixtypes_inst.h - instantiation of template file TMPL_FILE for all pixel types
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ *  HERE'S NO ANY "FILE-GUARDS" BECAUSE FILE IS MULTIPLY INCLUDED!
+ *  Look pixtypes.h for details.
+ *  PIXMIN, PIXMAX - range of type; PIXINT == 1 for integer types
+ */
+#include <float.h>
+#include "pixtypes.h"
+
+#define PIXTYPE		uint8_t
+#define PIXSFX		_u8
+#define PIXMIN		0
+#define PIXMAX		UINT8_MAX
+#define PIXINT		1
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
+
+#define PIXTYPE		int16_t
+#define PIXSFX		_i16
+#define PIXMIN		INT16_MIN
+#define PIXMAX		INT16_MAX
+#define PIXINT		1
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
+
+#define PIXTYPE		uint16_t
+#define PIXSFX		_u16
+#define PIXMIN		0
+#define PIXMAX		UINT16_MAX
+#define PIXINT		1
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
+
+#define PIXTYPE		int32_t
+#define PIXSFX		_i32
+#define PIXMIN		INT32_MIN
+#define PIXMAX		INT32_MAX
+#define PIXINT		1
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
+
+#define PIXTYPE		float
+#define PIXSFX		_f32
+#define PIXMIN		(-FLT_MAX)
+#define PIXMAX		FLT_MAX
+#define PIXINT		0
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
+
+#define PIXTYPE		Item
+#define PIXSFX
+#define PIXMIN		(-DBL_MAX)
+#define PIXMAX		DBL_MAX
+#define PIXINT		0
+#include TMPL_FILE
+#undef PIXTYPE
+#undef PIXSFX
+#undef PIXMIN
+#undef PIXMAX
+#undef PIXINT
@@ -0,0 +1,197 @@
+/*
+ * shmring.c - ring buffer of raw frames in POSIX shared memory
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include "shmring.h"
+#include "usefull_macros.h"
+
+// slots are aligned to this size (so data of any type would be aligned)
+#define SHMRING_ALIGN	(64)
+// polling interval (microseconds) while waiting for frames or free slots
+#define SHMRING_POLL	(50)
+
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+// header is padded to alignment of slots
+static size_t hdr_size(){
+	return (sizeof(shmring_hdr) + SHMRING_ALIGN - 1) / SHMRING_ALIGN * SHMRING_ALIGN;
+}
+
+size_t shmring_framesize(shmring *r){
+	return (size_t)r->hdr->width * r->hdr->height * (abs(r->hdr->bitpix) / 8);
+}
+
+static shmring *ring_map(char *name, int fd, size_t len, bool owner){
+	void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ptr == MAP_FAILED){
+		WARN(_("Can't map shared memory %s"), name);
+		if(owner) shm_unlink(name);
+		return NULL;
+	}
+	shmring *r = MALLOC(shmring, 1);
+	r->name = strdup(name);
+	r->hdr = (shmring_hdr*)ptr;
+	r->slots = (uint8_t*)ptr + hdr_size();
+	r->len = len;
+	r->owner = owner;
+	return r;
+}
+
+/**
+ * create ring buffer 'name' (old object with same name would be removed)
+ * for 'nslots' frames 'width'x'height' of type 'bitpix'
+ * @return NULL if failed
+ */
+shmring *shmring_create(char *name, int width, int height, int bitpix, int nslots){
+	int pixsz = abs(bitpix) / 8;
+	if(width < 1 || height < 1 || nslots < 1 || pixsz < 1 || pixsz > 8 || abs(bitpix) % 8){
+		WARNX(_("Wrong parameters of ring buffer"));
+		return NULL;
+	}
+	size_t slotsize = (size_t)width * height * pixsz;
+	slotsize = (slotsize + SHMRING_ALIGN - 1) / SHMRING_ALIGN * SHMRING_ALIGN;
+	size_t len = hdr_size() + slotsize * nslots;
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if(fd < 0){
+		WARN(_("Can't create shared memory %s"), name);
+		return NULL;
+	}
+	if(ftruncate(fd, len)){
+		WARN(_("Can't set size of shared memory %s"), name);
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	shmring *r = ring_map(name, fd, len, true);
+	if(!r) return NULL;
+	shmring_hdr *h = r->hdr;
+	h->version = SHMRING_VERSION;
+	h->width = width;
+	h->height = height;
+	h->bitpix = bitpix;
+	h->nslots = nslots;
+	h->slotsize = slotsize;
+	STORE(h->magic, SHMRING_MAGIC); // now consumer could use it
+	return r;
+}
+
+/**
+ * attach to ring buffer 'name' created by producer
+ * @param timeout - time (seconds) to wait for producer
+ * @return NULL if failed
+ */
+shmring *shmring_attach(char *name, double timeout){
+	double t0 = dtime();
+	int fd;
+	struct stat st;
+	while((fd = shm_open(name, O_RDWR, 0)) < 0 || fstat(fd, &st) || (size_t)st.st_size < hdr_size()){
+		if(fd > -1) close(fd);
+		if(dtime() - t0 > timeout){
+			WARNX(_("Shared memory %s not found"), name);
+			return NULL;
+		}
+		usleep(SHMRING_POLL * 100);
+	}
+	shmring *r = ring_map(name, fd, st.st_size, false);
+	if(!r) return NULL;
+	while(LOAD(r->hdr->magic) != SHMRING_MAGIC && dtime() - t0 < timeout) usleep(SHMRING_POLL);
+	shmring_hdr *h = r->hdr;
+	if(h->magic != SHMRING_MAGIC || h->version != SHMRING_VERSION
+		|| hdr_size() + h->slotsize * h->nslots > r->len || shmring_framesize(r) > h->slotsize){
+		WARNX(_("%s isn't a ring buffer of frames"), name);
+		shmring_close(&r);
+		return NULL;
+	}
+	return r;
+}
+
+/**
+ * consumer: wait for next frame
+ * @return pointer to frame data (valid until shmring_release()) or NULL if producer finished
+ */
+uint8_t *shmring_get(shmring *r){
+	shmring_hdr *h = r->hdr;
+	uint64_t tail = h->tail;
+	while(LOAD(h->head) == tail){
+		if(LOAD(h->closed) && LOAD(h->head) == tail) return NULL;
+		usleep(SHMRING_POLL);
+	}
+	return r->slots + (tail % h->nslots) * h->slotsize;
+}
+
+/**
+ * consumer: free slot of frame got by shmring_get()
+ */
+void shmring_release(shmring *r){
+	STORE(r->hdr->tail, r->hdr->tail + 1);
+}
+
+/**
+ * producer: wait for free slot
+ * @return pointer to slot for next frame
+ */
+uint8_t *shmring_reserve(shmring *r){
+	shmring_hdr *h = r->hdr;
+	uint64_t head = h->head;
+	while(head - LOAD(h->tail) >= h->nslots) usleep(SHMRING_POLL);
+	return r->slots + (head % h->nslots) * h->slotsize;
+}
+
+/**
+ * producer: publish frame written into slot got by shmring_reserve()
+ */
+void shmring_commit(shmring *r){
+	STORE(r->hdr->head, r->hdr->head + 1);
+}
+
+/**
+ * producer: no more frames
+ */
+void shmring_finish(shmring *r){
+	STORE(r->hdr->closed, 1);
+}
+
+/**
+ * producer: wait until consumer reads all frames
+ * @return FALSE if timeout (seconds) reached
+ */
+bool shmring_wait_empty(shmring *r, double timeout){
+	double t0 = dtime();
+	while(LOAD(r->hdr->tail) != r->hdr->head){
+		if(dtime() - t0 > timeout) return false;
+		usleep(SHMRING_POLL * 100);
+	}
+	return true;
+}
+
+/**
+ * unmap ring buffer (remove shared memory object if it was created by us)
+ */
+void shmring_close(shmring **r){
+	if(!r || !*r) return;
+	munmap((*r)->hdr, (*r)->len);
+	if((*r)->owner) shm_unlink((*r)->name);
+	FREE((*r)->name);
+	FREE(*r);
+}
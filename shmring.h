@@ -0,0 +1,70 @@
+/*
+ * shmring.h
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHMRING_MAGIC	(0x52544946)	// "FITR"
+#define SHMRING_VERSION	(1)
+
+/*
+ * POSIX shared memory segment with raw frames (single producer, single consumer):
+ * header followed by 'nslots' slots of 'slotsize' bytes;
+ * frame number N lays in slot N % nslots
+ */
+typedef struct{
+	uint32_t magic;			// SHMRING_MAGIC
+	uint32_t version;		// SHMRING_VERSION
+	uint32_t width;			// frame size (pixels)
+	uint32_t height;
+	int32_t bitpix;			// pixel type (BITPIX)
+	uint32_t nslots;		// amount of slots
+	uint64_t slotsize;		// size of slot (bytes), not less than frame size
+	uint64_t head;			// amount of frames written by producer (changed only by producer)
+	uint64_t tail;			// amount of frames read by consumer (changed only by consumer)
+	uint32_t closed;		// producer wouldn't write more frames
+	uint32_t reserved;
+} shmring_hdr;
+
+typedef struct{
+	char *name;				// name of shared memory object
+	shmring_hdr *hdr;		// mapped segment
+	uint8_t *slots;			// first slot
+	size_t len;				// size of mapped segment
+	bool owner;				// segment was created by us (should be removed at closing)
+} shmring;
+
+shmring *shmring_create(char *name, int width, int height, int bitpix, int nslots);
+shmring *shmring_attach(char *name, double timeout);
+size_t shmring_framesize(shmring *r);
+uint8_t *shmring_get(shmring *r);
+void shmring_release(shmring *r);
+uint8_t *shmring_reserve(shmring *r);
+void shmring_commit(shmring *r);
+void shmring_finish(shmring *r);
+bool shmring_wait_empty(shmring *r, double timeout);
+void shmring_close(shmring **r);
+
+#endif // __SHMRING_H__
@@ -0,0 +1,119 @@
+/*
+ * shmproducer.c - test producer of frames for ingest mode of fitsread (--ingest)
+ * writes synthetic frames (noise + moving star) into shared memory ring buffer
+ *
+ * Copyright 2015 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <math.h>
+#include <signal.h>
+#include "../usefull_macros.h"
+#include "../parseargs.h"
+#include "../shmring.h"
+
+static struct{
+	char *name;		// name of ring buffer
+	int width;		// frame size
+	int height;
+	int bitpix;		// pixel type
+	int nslots;		// amount of slots in ring
+	int nframes;	// amount of frames to send
+	double fps;		// frame rate (0 - as fast as consumer reads)
+	double wait;	// timeout for consumer
+} P = {
+	.name = "/fitsread_in",
+	.width = 1024,
+	.height = 1024,
+	.bitpix = 16,
+	.nslots = 8,
+	.nframes = 100,
+	.fps = 0.,
+	.wait = 10.
+};
+static int help;
+
+static myoption opts[] = {
+	{"help",	NO_ARGS,	NULL,	'h',	arg_int,	APTR(&help),		N_("show this help")},
+	{"name",	NEED_ARG,	NULL,	'n',	arg_string,	APTR(&P.name),		N_("name of ring buffer (default: /fitsread_in)")},
+	{"width",	NEED_ARG,	NULL,	'W',	arg_int,	APTR(&P.width),		N_("frame width (default: 1024)")},
+	{"height",	NEED_ARG,	NULL,	'H',	arg_int,	APTR(&P.height),	N_("frame height (default: 1024)")},
+	{"bitpix",	NEED_ARG,	NULL,	'b',	arg_int,	APTR(&P.bitpix),	N_("pixel type: 8, 16, 32, -32 or -64 (default: 16)")},
+	{"slots",	NEED_ARG,	NULL,	's',	arg_int,	APTR(&P.nslots),	N_("amount of slots in ring buffer (default: 8)")},
+	{"frames",	NEED_ARG,	NULL,	'N',	arg_int,	APTR(&P.nframes),	N_("amount of frames (default: 100)")},
+	{"fps",		NEED_ARG,	NULL,	'f',	arg_double,	APTR(&P.fps),		N_("frame rate (default: as fast as possible)")},
+	{"wait",	NEED_ARG,	NULL,	'w',	arg_double,	APTR(&P.wait),		N_("time to wait for consumer after last frame (seconds)")},
+	end_option
+};
+
+static shmring *ring = NULL;
+
+void signals(int sig){
+	shmring_close(&ring);
+	exit(sig);
+}
+
+/**
+ * fill frame 'n': background with noise & star moving by circle
+ */
+static void make_frame(uint8_t *buf, int n){
+	int w = P.width, h = P.height;
+	double x0 = w / 2. + w / 4. * cos(n * 0.1), y0 = h / 2. + h / 4. * sin(n * 0.1);
+	for(int y = 0; y < h; ++y){
+		double dy2 = (y - y0) * (y - y0);
+		for(int x = 0; x < w; ++x){
+			double v = 100. + 10. * (drand48() - 0.5) + 1000. * exp(-((x - x0) * (x - x0) + dy2) / 8.);
+			size_t i = (size_t)y * w + x;
+			switch(P.bitpix){
+				case 8:		buf[i] = (uint8_t)(v > 255. ? 255. : v); break;
+				case 16:	((int16_t*)buf)[i] = (int16_t)v; break;
+				case 32:	((int32_t*)buf)[i] = (int32_t)v; break;
+				case -32:	((float*)buf)[i] = (float)v; break;
+				default:	((double*)buf)[i] = v;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	initial_setup();
+	parseargs(&argc, &argv, opts);
+	if(help) showhelp(-1, opts);
+	if(P.bitpix != 8 && P.bitpix != 16 && P.bitpix != 32 && P.bitpix != -32 && P.bitpix != -64)
+		ERRX(_("Wrong pixel type: %d"), P.bitpix);
+	signal(SIGINT, signals);
+	signal(SIGTERM, signals);
+	if(!(ring = shmring_create(P.name, P.width, P.height, P.bitpix, P.nslots)))
+		ERRX(_("Can't create ring buffer %s"), P.name);
+	green("Ring %s: %dx%d, BITPIX=%d, %d slots\n", P.name, P.width, P.height, P.bitpix, P.nslots);
+	double t0 = dtime();
+	for(int n = 0; n < P.nframes; ++n){
+		uint8_t *slot = shmring_reserve(ring);
+		make_frame(slot, n);
+		if(P.fps > 0.){ // keep frame rate
+			double dt = t0 + n / P.fps - dtime();
+			if(dt > 0.) usleep((useconds_t)(dt * 1e6));
+		}
+		shmring_commit(ring);
+	}
+	shmring_finish(ring);
+	if(!shmring_wait_empty(ring, P.wait)) WARNX(_("Consumer didn't read all frames"));
+	t0 = dtime() - t0;
+	green("%d frames sent in %.2f seconds (%.1f frames per second)\n", P.nframes, t0, P.nframes / t0);
+	shmring_close(&ring);
+	return 0;
+}
@@ -40,6 +40,7 @@
 #define OMP_NUM_THREADS THREAD_NUMBER
 #define Stringify(x) #x
 #define OMP_FOR(x) _Pragma(Stringify(omp parallel for x))
+#define OMP_SIMD(x) _Pragma(Stringify(omp simd x))
 #ifndef MAX
 #define MAX(x,y) ((x) > (y) ? (x) : (y))
 #endif
@@ -76,6 +77,9 @@ typedef struct _Filter{
     int h;              // height
     double sx;          // x half-width
     double sy;          // y half-width (sx, sy - for Gaussian-type filters)
+    int method;         // computation method (GaussMethod for Gaussian)
+    Item min;           // data range of filter input if known before filtering
+    Item max;           //   (for processing by strips), max <= min if unknown
     IMAGE* (*imfunc)(IMAGE *in, struct _Filter *f, Itmarray *i);    // image function for given conversion type
 } Filter;
 
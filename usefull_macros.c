@@ -176,7 +176,8 @@ mmapbuf *My_mmap(char *filename){
 	if(fstat (fd, &statbuf) < 0)
 		ERR(_("Can't stat %s"), filename);
 	Mlen = statbuf.st_size;
-	if((ptr = mmap (0, Mlen, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	// private mapping: data could be changed in memory but not in file
+	if((ptr = mmap (0, Mlen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
 		ERR(_("Mmap error for input"));
 	if(close(fd)) ERR(_("Can't close mmap'ed file"));
 	mmapbuf *ret = MALLOC(mmapbuf, 1);